@@ -10,6 +10,7 @@ Also handles whitespaces/tabs/newlines.
 
 #include <string>
 #include <iostream>
+#include <memory>
 
 namespace token
 {
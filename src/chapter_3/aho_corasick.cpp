@@ -0,0 +1,133 @@
+/*
+Aho-Corasick multi-pattern matching, and how it compares to running KMP once
+per pattern.
+
+Usage: aho_corasick [patterns] [text KiB] [seed]
+
+Runs a small example, then benchmarks both on a random text of lowercase words
+(default 200 patterns in 256 KiB), checking they find the same matches.
+ */
+
+#include "aho_corasick.hpp"
+#include "kmp.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+std::string random_word(std::mt19937_64 &rng)
+{
+    std::uniform_int_distribution<int> length(4, 12);
+    std::uniform_int_distribution<int> letter('a', 'z');
+    std::string word(length(rng), ' ');
+    for (char &c : word)
+    {
+        c = static_cast<char>(letter(rng));
+    }
+    return word;
+}
+
+void example()
+{
+    std::vector<std::string> patterns = {"he", "she", "his", "hers"};
+    std::string text = "ushers";
+    std::cout << "Text: " << text << std::endl;
+
+    AhoCorasick automaton(patterns);
+    for (auto &match : automaton.find_all(text))
+    {
+        std::cout << "Found " << patterns[match.pattern_] << " at " << match.offset_ << std::endl;
+    }
+    std::cout << std::endl;
+}
+
+void benchmark(size_t pattern_count, size_t text_kib, unsigned long seed)
+{
+    std::mt19937_64 rng(seed);
+    std::vector<std::string> patterns(pattern_count);
+    for (auto &pattern : patterns)
+    {
+        pattern = random_word(rng);
+    }
+
+    // One word in 8 is a pattern, so there's something to find
+    std::string text;
+    std::uniform_int_distribution<size_t> pick(0, pattern_count - 1);
+    while (text.size() < text_kib * 1024)
+    {
+        text += rng() % 8 == 0 ? patterns[pick(rng)] : random_word(rng);
+        text += ' ';
+    }
+    double mib = text.size() / (1024.0 * 1024.0);
+    std::cout << "Benchmark: " << pattern_count << " patterns, " << text.size() << " bytes of text" << std::endl;
+
+    auto start = Clock::now();
+    AhoCorasick automaton(patterns);
+    double ac_build = seconds_since(start);
+
+    start = Clock::now();
+    std::vector<std::pair<size_t, size_t>> ac_matches;
+    automaton.scan(text, [&ac_matches](size_t pattern, size_t offset)
+                   { ac_matches.emplace_back(pattern, offset); });
+    double ac_scan = seconds_since(start);
+
+    start = Clock::now();
+    std::vector<std::vector<int>> failures;
+    failures.reserve(patterns.size());
+    for (auto &pattern : patterns)
+    {
+        failures.push_back(calculate_failure_function(pattern));
+    }
+    double kmp_build = seconds_since(start);
+
+    start = Clock::now();
+    std::vector<std::pair<size_t, size_t>> kmp_matches;
+    for (size_t p = 0; p < patterns.size(); p++)
+    {
+        for (size_t offset : match_kmp_all(text, patterns[p], failures[p]))
+        {
+            kmp_matches.emplace_back(p, offset);
+        }
+    }
+    double kmp_scan = seconds_since(start);
+
+    std::cout << std::left << std::setw(16) << "" << std::right << std::setw(12) << "build (s)" << std::setw(12)
+              << "scan (s)" << std::setw(12) << "MiB/s" << std::setw(12) << "matches" << std::endl;
+    std::cout << std::left << std::setw(16) << "aho-corasick" << std::right << std::setw(12) << ac_build
+              << std::setw(12) << ac_scan << std::setw(12) << mib / ac_scan << std::setw(12) << ac_matches.size()
+              << std::endl;
+    std::cout << std::left << std::setw(16) << "kmp per pattern" << std::right << std::setw(12) << kmp_build
+              << std::setw(12) << kmp_scan << std::setw(12) << mib / kmp_scan << std::setw(12) << kmp_matches.size()
+              << std::endl;
+    std::cout << "Automaton: " << automaton.state_count() << " states, " << automaton.table_bytes()
+              << " bytes of transitions" << std::endl;
+
+    std::sort(ac_matches.begin(), ac_matches.end());
+    std::sort(kmp_matches.begin(), kmp_matches.end());
+    std::cout << (ac_matches == kmp_matches ? "Matches agree" : "Matches DIFFER") << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t pattern_count = argc > 1 ? std::stoul(argv[1]) : 200;
+    size_t text_kib = argc > 2 ? std::stoul(argv[2]) : 256;
+    unsigned long seed = argc > 3 ? std::stoul(argv[3]) : 1;
+
+    example();
+    if (pattern_count > 0)
+    {
+        benchmark(pattern_count, text_kib, seed);
+    }
+}
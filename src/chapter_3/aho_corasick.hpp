@@ -0,0 +1,229 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Aho-Corasick automaton: finds every occurrence of many patterns at once,
+// in a single pass over the text.
+//
+// The patterns are put in a trie, and each trie node gets a failure link: the
+// longest proper suffix of the node's string that is also a node. This is the
+// KMP failure function (see kmp.hpp), computed over the whole trie instead of
+// a single pattern, breadth first, so a node's failure is always known before
+// its children's. Failures are then folded into the transitions, making the
+// automaton deterministic: one table lookup per byte of text, no backtracking.
+//
+// Transitions are stored densely, one row per state. Bytes that appear in no
+// pattern share a single column, so rows stay short, and states are numbered
+// breadth first, so the shallow states most of the scan runs in are close
+// together in memory.
+class AhoCorasick
+{
+public:
+    struct Match
+    {
+        size_t pattern_; // Index of the pattern in the constructor's list
+        size_t offset_;  // Where the occurrence starts in the text
+    };
+
+    // Empty patterns never match
+    explicit AhoCorasick(const std::vector<std::string> &patterns)
+    {
+        build_alphabet(patterns);
+
+        // Trie
+        std::vector<int32_t> children(classes_, -1);
+        std::vector<int32_t> first_pattern(1, -1);
+        pattern_next_.assign(patterns.size(), -1);
+        lengths_.resize(patterns.size());
+        for (size_t p = 0; p < patterns.size(); p++)
+        {
+            lengths_[p] = patterns[p].size();
+            if (patterns[p].empty())
+            {
+                continue;
+            }
+            int32_t state = 0;
+            for (unsigned char c : patterns[p])
+            {
+                size_t edge = state * classes_ + class_[c];
+                if (children[edge] < 0)
+                {
+                    children[edge] = static_cast<int32_t>(first_pattern.size());
+                    first_pattern.push_back(-1);
+                    children.resize(children.size() + classes_, -1);
+                }
+                state = children[edge];
+            }
+            // Patterns ending at the same state are chained, in order
+            int32_t *last = &first_pattern[state];
+            while (*last >= 0)
+            {
+                last = &pattern_next_[*last];
+            }
+            *last = static_cast<int32_t>(p);
+        }
+        size_t states = first_pattern.size();
+        if (states * classes_ > INT32_MAX / 2)
+        {
+            throw "Too many patterns for AhoCorasick";
+        }
+
+        // Failure links, breadth first. Missing transitions are filled in
+        // with the failure's, which is already complete.
+        std::vector<int32_t> fail(states, 0);
+        std::vector<int32_t> order;
+        order.reserve(states);
+        order.push_back(0);
+        for (size_t c = 0; c < classes_; c++)
+        {
+            int32_t &child = children[c];
+            if (child < 0)
+            {
+                child = 0;
+            }
+            else
+            {
+                order.push_back(child);
+            }
+        }
+        for (size_t i = 1; i < order.size(); i++)
+        {
+            int32_t state = order[i];
+            for (size_t c = 0; c < classes_; c++)
+            {
+                int32_t &child = children[state * classes_ + c];
+                int32_t fallback = children[fail[state] * classes_ + c];
+                if (child < 0)
+                {
+                    child = fallback;
+                }
+                else
+                {
+                    fail[child] = fallback;
+                    order.push_back(child);
+                }
+            }
+        }
+
+        // Renumber states breadth first. Transitions hold the offset of the
+        // target's row, shifted left, with the low bit set if the target
+        // reports matches: most bytes then take a single lookup.
+        std::vector<int32_t> renumbered(states);
+        for (size_t i = 0; i < states; i++)
+        {
+            renumbered[order[i]] = static_cast<int32_t>(i);
+        }
+        transitions_.resize(states * classes_);
+        first_pattern_.resize(states);
+        report_.resize(states);
+        next_report_.resize(states);
+        for (size_t i = 0; i < states; i++)
+        {
+            int32_t state = order[i];
+            first_pattern_[i] = first_pattern[state];
+            // Nearest state along the failure chain (this one included) where a
+            // pattern ends. Failures are shallower, so theirs is already known.
+            int32_t failure = i == 0 ? -1 : renumbered[fail[state]];
+            next_report_[i] = failure < 0 ? -1 : report_[failure];
+            report_[i] = first_pattern_[i] >= 0 ? static_cast<int32_t>(i) : next_report_[i];
+        }
+        for (size_t i = 0; i < states; i++)
+        {
+            for (size_t c = 0; c < classes_; c++)
+            {
+                uint32_t target = static_cast<uint32_t>(renumbered[children[order[i] * classes_ + c]]);
+                transitions_[i * classes_ + c] = (target * static_cast<uint32_t>(classes_)) << 1 | (report_[target] >= 0);
+            }
+        }
+    }
+
+    size_t state_count() const
+    {
+        return first_pattern_.size();
+    }
+
+    // Bytes of transition table
+    size_t table_bytes() const
+    {
+        return transitions_.size() * sizeof(uint32_t);
+    }
+
+    // Calls on_match(pattern, offset) for every occurrence of every pattern,
+    // in order of where they end in the text (then longest first)
+    template <typename F>
+    void scan(std::string_view text, F &&on_match) const
+    {
+        const uint32_t *transitions = transitions_.data();
+        const uint16_t *classes = class_;
+        uint32_t row = 0;
+        for (size_t i = 0; i < text.size(); i++)
+        {
+            uint32_t next = transitions[row + classes[static_cast<unsigned char>(text[i])]];
+            row = next >> 1;
+            if (!(next & 1))
+            {
+                continue;
+            }
+            int32_t state = report_[row / classes_];
+            while (state >= 0)
+            {
+                for (int32_t p = first_pattern_[state]; p >= 0; p = pattern_next_[p])
+                {
+                    on_match(static_cast<size_t>(p), i + 1 - lengths_[p]);
+                }
+                state = next_report_[state];
+            }
+        }
+    }
+
+    std::vector<Match> find_all(std::string_view text) const
+    {
+        std::vector<Match> matches;
+        scan(text, [&matches](size_t pattern, size_t offset)
+             { matches.push_back(Match{pattern, offset}); });
+        return matches;
+    }
+
+    // Number of occurrences, without collecting them
+    size_t count(std::string_view text) const
+    {
+        size_t n = 0;
+        scan(text, [&n](size_t, size_t)
+             { n++; });
+        return n;
+    }
+
+private:
+    // Bytes used by the patterns get a column each, all others share column 0
+    void build_alphabet(const std::vector<std::string> &patterns)
+    {
+        for (uint16_t &c : class_)
+        {
+            c = 0;
+        }
+        classes_ = 1;
+        for (const std::string &pattern : patterns)
+        {
+            for (unsigned char c : pattern)
+            {
+                if (class_[c] == 0)
+                {
+                    class_[c] = static_cast<uint16_t>(classes_++);
+                }
+            }
+        }
+    }
+
+    uint16_t class_[256];
+    size_t classes_;
+    std::vector<uint32_t> transitions_;  // Next state, per state and column (see constructor)
+    std::vector<int32_t> report_;        // First state to report from, or -1 if none
+    std::vector<int32_t> next_report_;   // Next state to report from, after this one
+    std::vector<int32_t> first_pattern_; // First pattern ending at this state, or -1
+    std::vector<int32_t> pattern_next_;  // Next pattern ending at the same state, or -1
+    std::vector<size_t> lengths_;
+};
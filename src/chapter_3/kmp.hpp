@@ -0,0 +1,90 @@
+#pragma once
+
+// KMP string matching, shared by the chapter 3 programs
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Calculate the failure function values, to use in KMP algorithm
+inline std::vector<int> calculate_failure_function(const std::string &str)
+{
+    std::vector<int> f(str.size(), 0);
+    int x = 0;
+    for (int y = 1; y < str.size(); y++)
+    {
+        // Find longest prefix that is also a postfix
+        while (x > 0 && str[y] != str[x])
+        {
+            x = f[x - 1];
+        }
+        if (str[y] == str[x])
+        {
+            x = x + 1;
+            f[y] = x;
+        }
+        else
+        {
+            f[y] = 0;
+        }
+    }
+    return f;
+}
+
+// KMP algorithm, finds the first occurance of string b in string a, using
+// a vector of failure function values (f)
+// On match, returns an integer indicating "how far in" string a we found string b
+// Returns -1 on no match.
+inline int match_kmp(std::string &a, std::string &b, std::vector<int> &f)
+{
+    int s = 0;
+    for (int i = 0; i < a.size(); i++)
+    {
+        while (s > 0 && a[i] != b[s])
+            s = f[s - 1];
+        if (a[i] == b[s])
+            s = s + 1;
+        if (s == b.size())
+            return (i - s + 1);
+    }
+    return -1;
+}
+
+// Like match_kmp, but calls on_match(offset) for every occurrence of string
+// b in string a at or after offset from, overlapping ones included. Stops
+// early, returning false, if on_match returns false.
+template <typename F>
+bool for_each_match_kmp(std::string_view a, std::string_view b, const std::vector<int> &f, uint64_t from,
+                        F &&on_match)
+{
+    if (b.empty())
+        return true;
+    size_t s = 0;
+    for (uint64_t i = from; i < a.size(); i++)
+    {
+        while (s > 0 && a[i] != b[s])
+            s = f[s - 1];
+        if (a[i] == b[s])
+            s = s + 1;
+        if (s == b.size())
+        {
+            if (!on_match(i - s + 1))
+                return false;
+            // Keep going from the longest proper prefix that's also a suffix
+            s = f[s - 1];
+        }
+    }
+    return true;
+}
+
+// Offsets of every occurrence of string b in string a
+inline std::vector<size_t> match_kmp_all(const std::string &a, const std::string &b, const std::vector<int> &f)
+{
+    std::vector<size_t> matches;
+    for_each_match_kmp(a, b, f, 0, [&matches](uint64_t offset)
+                       { matches.push_back(offset);
+                         return true; });
+    return matches;
+}
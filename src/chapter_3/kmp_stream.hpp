@@ -0,0 +1,82 @@
+#pragma once
+
+#include "kmp.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// KMP over a stream, fed one chunk at a time.
+//
+// The matcher only keeps the KMP state (how much of the pattern the end of
+// the stream so far matches) between chunks, so occurrences spanning chunk
+// boundaries are found without keeping any text around: memory is the
+// pattern and its failure function, whatever the size of the stream.
+//
+// Offsets are absolute (from the start of the stream) and 64-bit.
+class StreamingKmp
+{
+public:
+    // An empty pattern never matches
+    explicit StreamingKmp(std::string pattern)
+        : pattern_(std::move(pattern)), failure_(calculate_failure_function(pattern_)) {}
+
+    // Calls on_match(offset) for every occurrence ending in chunk, in order
+    template <typename F>
+    void feed(std::string_view chunk, F &&on_match)
+    {
+        const char *data = chunk.data();
+        const size_t n = chunk.size();
+        const size_t m = pattern_.size();
+        if (m == 0)
+        {
+            consumed_ += n;
+            return;
+        }
+        size_t s = s_;
+        for (size_t i = 0; i < n; i++)
+        {
+            if (s == 0)
+            {
+                // Nothing matched so far: skip to the next byte that can start
+                // a match. memchr goes through many bytes at a time.
+                const void *next = std::memchr(data + i, pattern_[0], n - i);
+                if (!next)
+                    break;
+                i = static_cast<const char *>(next) - data;
+            }
+            while (s > 0 && data[i] != pattern_[s])
+                s = failure_[s - 1];
+            if (data[i] == pattern_[s])
+                s = s + 1;
+            if (s == m)
+            {
+                on_match(consumed_ + i + 1 - m);
+                s = failure_[s - 1];
+            }
+        }
+        s_ = s;
+        consumed_ += n;
+    }
+
+    // Bytes fed so far
+    uint64_t position() const
+    {
+        return consumed_;
+    }
+
+    // Starts over, as if on a new stream
+    void reset()
+    {
+        s_ = 0;
+        consumed_ = 0;
+    }
+
+private:
+    std::string pattern_;
+    std::vector<int> failure_;
+    size_t s_ = 0;          // Length of the pattern prefix the stream currently ends with
+    uint64_t consumed_ = 0; // Absolute offset of the next chunk
+};
@@ -0,0 +1,271 @@
+#pragma once
+
+#include "kmp.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// KMP over a large in-memory text, on several threads.
+//
+// The text is split in fixed-size chunks of match start positions, which
+// worker threads take in order from a shared counter. Each chunk is searched
+// on its own, with the one failure table (only ever read), over its range
+// plus the pattern length minus one bytes of the next, so matches across
+// chunk boundaries are found. Only matches starting in its own range are
+// kept, so none is found twice; merging is putting the chunks back in order.
+//
+// find_first() stops every thread once a match is known before the parts
+// they're still searching.
+//
+// The worker threads live as long as the object, so repeated searches don't
+// pay for starting threads: each search hands them its chunks, and the
+// calling thread takes chunks too. Searches from several threads at once
+// take turns.
+class ParallelKmp
+{
+public:
+    static constexpr uint64_t npos = ~uint64_t(0);
+
+    // threads = 0 uses every core. An empty pattern never matches.
+    explicit ParallelKmp(std::string pattern, size_t threads = 0, size_t chunk_size = size_t(4) << 20)
+        : pattern_(std::move(pattern)), failure_(calculate_failure_function(pattern_)),
+          threads_(threads ? threads : std::max(1u, std::thread::hardware_concurrency())),
+          chunk_size_(std::max<size_t>(chunk_size, 1))
+    {
+        for (size_t i = 1; i < threads_; i++)
+        {
+            workers_.emplace_back([this]()
+                                  { work(); });
+        }
+    }
+
+    ~ParallelKmp()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        job_ready_.notify_all();
+        for (auto &worker : workers_)
+        {
+            worker.join();
+        }
+    }
+
+    // The workers point into the object
+    ParallelKmp(const ParallelKmp &) = delete;
+    ParallelKmp &operator=(const ParallelKmp &) = delete;
+
+    size_t threads() const
+    {
+        return threads_;
+    }
+
+    // Offsets of every occurrence, in order
+    std::vector<uint64_t> find_all(std::string_view text) const
+    {
+        std::vector<std::vector<uint64_t>> found(chunk_count(text));
+        run(found.size(), [this, text, &found](size_t chunk)
+            { search_range(text, chunk_begin(chunk), chunk_end(text, chunk), [&found, chunk](uint64_t offset)
+                           { found[chunk].push_back(offset);
+                             return true; }); });
+
+        size_t total = 0;
+        for (auto &matches : found)
+        {
+            total += matches.size();
+        }
+        std::vector<uint64_t> matches;
+        matches.reserve(total);
+        for (auto &chunk : found)
+        {
+            matches.insert(matches.end(), chunk.begin(), chunk.end());
+        }
+        return matches;
+    }
+
+    uint64_t count(std::string_view text) const
+    {
+        std::vector<uint64_t> counts(chunk_count(text), 0);
+        run(counts.size(), [this, text, &counts](size_t chunk)
+            {
+                uint64_t n = 0;
+                search_range(text, chunk_begin(chunk), chunk_end(text, chunk), [&n](uint64_t)
+                             { n++;
+                               return true; });
+                counts[chunk] = n; });
+
+        uint64_t total = 0;
+        for (uint64_t n : counts)
+        {
+            total += n;
+        }
+        return total;
+    }
+
+    // Offset of the first occurrence, or npos if none
+    uint64_t find_first(std::string_view text) const
+    {
+        std::atomic<uint64_t> first{npos};
+        run(chunk_count(text), [this, text, &first](size_t chunk)
+            { find_first_in_chunk(text, chunk, first); });
+        return first.load();
+    }
+
+private:
+    // Match starts searched between checks for cancellation
+    static constexpr uint64_t cancel_slice = uint64_t(64) << 10;
+
+    // Number of chunks of match start positions
+    size_t chunk_count(std::string_view text) const
+    {
+        if (pattern_.empty() || text.size() < pattern_.size())
+        {
+            return 0;
+        }
+        uint64_t starts = text.size() - pattern_.size() + 1;
+        return static_cast<size_t>((starts + chunk_size_ - 1) / chunk_size_);
+    }
+
+    uint64_t chunk_begin(size_t chunk) const
+    {
+        return static_cast<uint64_t>(chunk) * chunk_size_;
+    }
+
+    uint64_t chunk_end(std::string_view text, size_t chunk) const
+    {
+        return std::min<uint64_t>(chunk_begin(chunk) + chunk_size_, text.size() - pattern_.size() + 1);
+    }
+
+    // Lowers first to the first match in chunk, if any. Chunks are taken in
+    // order, so once a match is known, later chunks are skipped; they're
+    // searched a slice at a time, so the ones under way stop early too.
+    void find_first_in_chunk(std::string_view text, size_t chunk, std::atomic<uint64_t> &first) const
+    {
+        auto lower = [&first](uint64_t offset)
+        {
+            uint64_t known = first.load(std::memory_order_relaxed);
+            while (offset < known && !first.compare_exchange_weak(known, offset, std::memory_order_relaxed))
+            {
+            }
+            return false;
+        };
+
+        uint64_t end = chunk_end(text, chunk);
+        for (uint64_t begin = chunk_begin(chunk); begin < end; begin += cancel_slice)
+        {
+            if (first.load(std::memory_order_relaxed) < begin)
+            {
+                return;
+            }
+            if (!search_range(text, begin, std::min(end, begin + cancel_slice), lower))
+            {
+                return;
+            }
+        }
+    }
+
+    // Calls on_match(offset) for every match starting in [begin, end), until
+    // it returns false. Returns false if it did.
+    template <typename F>
+    bool search_range(std::string_view text, uint64_t begin, uint64_t end, F &&on_match) const
+    {
+        std::string_view range = text.substr(begin, end - begin + pattern_.size() - 1);
+        return for_each_match_kmp(range, pattern_, failure_, 0, [begin, &on_match](uint64_t offset)
+                                  { return on_match(begin + offset); });
+    }
+
+    // Runs task(chunk) for every chunk, on the workers and the calling
+    // thread, each taking the next chunk when done with one. A single chunk
+    // is searched right away, without waking anyone.
+    template <typename Task>
+    void run(size_t chunks, Task task) const
+    {
+        if (chunks <= 1 || workers_.empty())
+        {
+            for (size_t chunk = 0; chunk < chunks; chunk++)
+            {
+                task(chunk);
+            }
+            return;
+        }
+
+        std::lock_guard<std::mutex> turn(run_mutex_);
+        std::function<void(size_t)> job(std::ref(task));
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            job_ = &job;
+            chunks_ = chunks;
+            next_ = 0;
+            busy_ = workers_.size();
+            generation_++;
+        }
+        job_ready_.notify_all();
+        take_chunks();
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        job_done_.wait(lock, [this]()
+                       { return busy_ == 0; });
+        job_ = nullptr;
+    }
+
+    void take_chunks() const
+    {
+        for (size_t chunk = next_++; chunk < chunks_; chunk = next_++)
+        {
+            (*job_)(chunk);
+        }
+    }
+
+    // Worker thread: helps with every job until the object is destroyed
+    void work() const
+    {
+        uint64_t done = 0;
+        while (true)
+        {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                job_ready_.wait(lock, [this, done]()
+                                { return stopping_ || generation_ != done; });
+                if (stopping_)
+                {
+                    return;
+                }
+                done = generation_;
+            }
+            take_chunks();
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--busy_ == 0)
+            {
+                job_done_.notify_one();
+            }
+        }
+    }
+
+    std::string pattern_;
+    std::vector<int> failure_;
+    size_t threads_;
+    size_t chunk_size_;
+
+    mutable std::mutex run_mutex_; // Held by the search running
+
+    // The job being run, set under mutex_ before generation_ moves on
+    mutable std::mutex mutex_;
+    mutable std::condition_variable job_ready_;
+    mutable std::condition_variable job_done_;
+    mutable const std::function<void(size_t)> *job_ = nullptr;
+    mutable size_t chunks_ = 0;
+    mutable std::atomic<size_t> next_{0};
+    mutable size_t busy_ = 0;       // Workers yet to finish the job
+    mutable uint64_t generation_ = 0; // Jobs started
+    bool stopping_ = false;
+    std::vector<std::thread> workers_;
+};
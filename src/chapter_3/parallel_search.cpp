@@ -0,0 +1,90 @@
+/*
+KMP search of a large in-memory text on several threads, and how it scales.
+
+Usage: parallel_search [text MiB] [max threads] [seed]
+
+Counts, collects and finds the first match of a pattern in a random text
+(default 256 MiB), with 1, 2, 4... threads up to max threads (default: the
+number of cores), checking the results against a single-threaded KMP pass.
+ */
+
+#include "kmp.hpp"
+#include "parallel_kmp.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    size_t mib = argc > 1 ? std::stoul(argv[1]) : 256;
+    size_t max_threads = argc > 2 ? std::stoul(argv[2]) : std::max(1u, std::thread::hardware_concurrency());
+    unsigned long seed = argc > 3 ? std::stoul(argv[3]) : 1;
+
+    // Random text over a small alphabet, so partial matches are common
+    std::mt19937_64 rng(seed);
+    std::string text(mib << 20, ' ');
+    for (char &c : text)
+    {
+        c = "abcd"[rng() % 4];
+    }
+    std::string pattern = "abcdabcdab";
+    std::cout << "Text: " << text.size() << " bytes, pattern: " << pattern << std::endl;
+
+    auto start = Clock::now();
+    std::vector<int> f = calculate_failure_function(pattern);
+    std::vector<uint64_t> expected;
+    for_each_match_kmp(text, pattern, f, 0, [&expected](uint64_t offset)
+                       { expected.push_back(offset);
+                         return true; });
+    double sequential = seconds_since(start);
+    std::cout << "Sequential KMP: " << sequential << " s, " << expected.size() << " matches" << std::endl;
+
+    std::cout << std::setw(8) << "threads" << std::setw(12) << "count (s)" << std::setw(12) << "all (s)"
+              << std::setw(12) << "first (s)" << std::setw(10) << "speedup" << std::endl;
+    std::vector<size_t> thread_counts;
+    for (size_t threads = 1; threads < max_threads; threads *= 2)
+    {
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(std::max<size_t>(max_threads, 1));
+    for (size_t threads : thread_counts)
+    {
+        ParallelKmp matcher(pattern, threads);
+
+        start = Clock::now();
+        uint64_t count = matcher.count(text);
+        double count_s = seconds_since(start);
+
+        start = Clock::now();
+        std::vector<uint64_t> all = matcher.find_all(text);
+        double all_s = seconds_since(start);
+
+        start = Clock::now();
+        uint64_t first = matcher.find_first(text);
+        double first_s = seconds_since(start);
+
+        std::cout << std::setw(8) << threads << std::setw(12) << count_s << std::setw(12) << all_s << std::setw(12)
+                  << first_s << std::setw(10) << std::setprecision(3) << sequential / count_s << std::endl;
+        std::cout << std::setprecision(6);
+        uint64_t expected_first = expected.empty() ? ParallelKmp::npos : expected.front();
+        if (count != expected.size() || all != expected || first != expected_first)
+        {
+            std::cout << "Results DIFFER from sequential KMP" << std::endl;
+            return -1;
+        }
+    }
+    std::cout << "Results agree" << std::endl;
+}
@@ -0,0 +1,1055 @@
+#pragma once
+
+#include <algorithm>
+#include <bitset>
+#include <cstring>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Regular expression search, with a DFA built lazily from a Thompson NFA.
+//
+// Syntax:
+//     abc        literal bytes          \. \* \\ ...   escaped metacharacters
+//     .          any byte but '\n'      \n \t \r \f \v control characters
+//     [a-z_]     byte class             \d \w \s       digits, word, space
+//     [^0-9]     negated byte class     \D \W \S       and their complements
+//     a|b        alternation            (...)          grouping
+//     * + ?      repetition             {n} {n,} {n,m} bounded repetition
+//     *? +? ?? {n,m}?                   lazy repetition
+//     ^ $        start and end of a line (or of the text)
+//
+// Matches follow the leftmost-first rule of Perl-style engines (and of
+// std::regex): the match that starts first wins, and among those, the one
+// preferred by greedy or lazy repetition and by the order of alternatives.
+// Except where a repeated group can match the empty string: Perl and
+// std::regex stop repeating after an iteration that matched empty, which a
+// DFA can't track, so here the loop carries on. On "aab", (a??)+ matches
+// "aa" here but "" there, and (a*?)* matches "a" here but "" there.
+//
+// The pattern is compiled to a Thompson NFA, which is never run directly:
+// DFA states (each the ordered set of NFA states active at some point) are
+// built the first time a search needs them, and cached. Searches then take
+// one table lookup per byte, and never backtrack, so each search is linear
+// in the length of text it looks at, whatever the pattern. The cache has a
+// memory budget: when it's full, it's cleared and rebuilt as needed, which
+// costs time but keeps memory bounded.
+//
+// A forward search finds where the leftmost-first match ends, then a search
+// backwards from there, with the reversed pattern, finds where it starts.
+//
+// Searches fill the caches, so a Regex must not be shared between threads.
+class Regex
+{
+public:
+    static constexpr uint64_t npos = ~uint64_t(0);
+
+    struct Match
+    {
+        uint64_t begin_;
+        uint64_t end_; // One past the last byte
+    };
+
+    // Throws on malformed patterns, and on patterns that make too large an
+    // NFA. cache_bytes bounds each of the DFAs (up to three: forward search,
+    // backward search and full match), bar one state larger than that.
+    explicit Regex(std::string_view pattern, size_t cache_bytes = size_t(2) << 20)
+        : cache_bytes_(cache_bytes)
+    {
+        Parser parser(pattern, ast_);
+        root_ = parser.parse();
+        build_classes();
+
+        // Forward: the pattern, behind a lazy loop over any byte so a match
+        // can start anywhere, with the earliest start preferred
+        int match = forward_.add(NfaState{NfaKind::match});
+        int start = compile(forward_, root_, match, false);
+        int prefix = forward_.add(NfaState{NfaKind::split, 0, start});
+        int any = forward_.add(NfaState{NfaKind::set, any_byte(), prefix});
+        forward_.states_[prefix].out1_ = any;
+        forward_.start_ = prefix;
+
+        // Backward: the reversed pattern, anchored at the end of the match
+        match = backward_.add(NfaState{NfaKind::match});
+        backward_.start_ = compile(backward_, root_, match, true);
+    }
+
+    // The DFAs point into the Regex
+    Regex(const Regex &) = delete;
+    Regex &operator=(const Regex &) = delete;
+
+    // Finds the first match starting at or after from
+    bool find(std::string_view text, Match &match, uint64_t from = 0)
+    {
+        if (from > text.size())
+        {
+            return false;
+        }
+        Dfa &forward = dfa(forward_dfa_, forward_, true);
+        uint64_t end = forward.scan_forward(text, from);
+        if (end == npos)
+        {
+            return false;
+        }
+        Dfa &backward = dfa(backward_dfa_, backward_, false);
+        match = Match{backward.scan_backward(text, from, end), end};
+        return true;
+    }
+
+    // Calls on_match(match) for every match, in order, without overlaps.
+    // After an empty match, search resumes one byte further.
+    template <typename F>
+    void for_each(std::string_view text, F &&on_match)
+    {
+        Match match;
+        uint64_t from = 0;
+        while (find(text, match, from))
+        {
+            on_match(match);
+            from = match.end_ > match.begin_ ? match.end_ : match.end_ + 1;
+        }
+    }
+
+    uint64_t count(std::string_view text)
+    {
+        uint64_t n = 0;
+        for_each(text, [&n](const Match &)
+                 { n++; });
+        return n;
+    }
+
+    // True if the whole text matches
+    bool full_match(std::string_view text)
+    {
+        if (anchored_.states_.empty())
+        {
+            int match = anchored_.add(NfaState{NfaKind::match});
+            anchored_.start_ = compile(anchored_, root_, match, false);
+        }
+        Dfa &anchored = dfa(anchored_dfa_, anchored_, false);
+        return anchored.scan_forward(text, 0) == text.size();
+    }
+
+    // DFA states currently cached, over all DFAs
+    size_t dfa_states() const
+    {
+        return (forward_dfa_ ? forward_dfa_->state_count() : 0) + (backward_dfa_ ? backward_dfa_->state_count() : 0) +
+               (anchored_dfa_ ? anchored_dfa_->state_count() : 0);
+    }
+
+    // Times a DFA cache was full and got cleared
+    size_t cache_resets() const
+    {
+        return (forward_dfa_ ? forward_dfa_->resets() : 0) + (backward_dfa_ ? backward_dfa_->resets() : 0) +
+               (anchored_dfa_ ? anchored_dfa_->resets() : 0);
+    }
+
+private:
+    using ByteSet = std::bitset<256>;
+
+    // Repetition bounds are expanded into copies, so they're kept small
+    static constexpr int max_repeat = 1000;
+    static constexpr int unbounded = -1;
+    // Bounds the work of every DFA transition, and the size of every state
+    static constexpr size_t max_nfa_states = 100000;
+
+    // Syntax tree
+
+    enum class NodeKind
+    {
+        set,        // One byte out of sets_[set_]
+        empty,      // Matches the empty string
+        concat,     // children_ one after the other
+        alternate,  // One of children_, the first ones preferred
+        repeat,     // children_[0], min_ to max_ times
+        line_start, // ^
+        line_end    // $
+    };
+
+    struct Node
+    {
+        explicit Node(NodeKind kind) : kind_(kind) {}
+
+        NodeKind kind_;
+        int set_ = 0;
+        std::vector<int> children_;
+        int min_ = 0;
+        int max_ = 0;
+        bool greedy_ = true;
+    };
+
+    struct Ast
+    {
+        std::vector<Node> nodes_;
+        std::vector<ByteSet> sets_;
+
+        int add(Node node)
+        {
+            nodes_.push_back(std::move(node));
+            return static_cast<int>(nodes_.size()) - 1;
+        }
+
+        int add_set(const ByteSet &set)
+        {
+            sets_.push_back(set);
+            Node node{NodeKind::set};
+            node.set_ = static_cast<int>(sets_.size()) - 1;
+            return add(node);
+        }
+    };
+
+    // Recursive descent parser:
+    //     alternation := concat ('|' concat)*
+    //     concat      := repeat*
+    //     repeat      := atom ('*' | '+' | '?' | '{' n [',' [m]] '}')* ['?']
+    //     atom        := '(' alternation ')' | '[' class ']' | '.' | '^' | '$' | escape | byte
+    class Parser
+    {
+    public:
+        Parser(std::string_view pattern, Ast &ast) : pattern_(pattern), ast_(ast) {}
+
+        int parse()
+        {
+            int root = parse_alternation();
+            if (pos_ < pattern_.size())
+            {
+                throw "Regex error: unmatched )";
+            }
+            return root;
+        }
+
+    private:
+        bool at_end() const
+        {
+            return pos_ >= pattern_.size();
+        }
+
+        char peek() const
+        {
+            return pattern_[pos_];
+        }
+
+        int parse_alternation()
+        {
+            Node node{NodeKind::alternate};
+            node.children_.push_back(parse_concat());
+            while (!at_end() && peek() == '|')
+            {
+                pos_++;
+                node.children_.push_back(parse_concat());
+            }
+            return node.children_.size() == 1 ? node.children_[0] : ast_.add(node);
+        }
+
+        int parse_concat()
+        {
+            Node node{NodeKind::concat};
+            while (!at_end() && peek() != '|' && peek() != ')')
+            {
+                node.children_.push_back(parse_repeat());
+            }
+            if (node.children_.empty())
+            {
+                return ast_.add(Node{NodeKind::empty});
+            }
+            return node.children_.size() == 1 ? node.children_[0] : ast_.add(node);
+        }
+
+        int parse_repeat()
+        {
+            int atom = parse_atom();
+            while (!at_end())
+            {
+                Node node{NodeKind::repeat};
+                char c = peek();
+                if (c == '*')
+                {
+                    node.min_ = 0;
+                    node.max_ = unbounded;
+                }
+                else if (c == '+')
+                {
+                    node.min_ = 1;
+                    node.max_ = unbounded;
+                }
+                else if (c == '?')
+                {
+                    node.min_ = 0;
+                    node.max_ = 1;
+                }
+                else if (c == '{')
+                {
+                    parse_bounds(node);
+                }
+                else
+                {
+                    break;
+                }
+                pos_++;
+                if (!at_end() && peek() == '?')
+                {
+                    node.greedy_ = false;
+                    pos_++;
+                }
+                node.children_.push_back(atom);
+                atom = ast_.add(node);
+            }
+            return atom;
+        }
+
+        // {n}, {n,} or {n,m}, leaving pos_ on the '}'
+        void parse_bounds(Node &node)
+        {
+            pos_++;
+            node.min_ = parse_number();
+            node.max_ = node.min_;
+            if (!at_end() && peek() == ',')
+            {
+                pos_++;
+                node.max_ = !at_end() && peek() == '}' ? unbounded : parse_number();
+            }
+            if (at_end() || peek() != '}')
+            {
+                throw "Regex error: malformed {n,m} repetition";
+            }
+            if (node.max_ != unbounded && node.max_ < node.min_)
+            {
+                throw "Regex error: {n,m} repetition with m < n";
+            }
+        }
+
+        int parse_number()
+        {
+            if (at_end() || peek() < '0' || peek() > '9')
+            {
+                throw "Regex error: malformed {n,m} repetition";
+            }
+            int n = 0;
+            while (!at_end() && peek() >= '0' && peek() <= '9')
+            {
+                n = n * 10 + (peek() - '0');
+                if (n > max_repeat)
+                {
+                    throw "Regex error: repetition count too large";
+                }
+                pos_++;
+            }
+            return n;
+        }
+
+        int parse_atom()
+        {
+            char c = peek();
+            pos_++;
+            switch (c)
+            {
+            case '(':
+            {
+                int inner = parse_alternation();
+                if (at_end() || peek() != ')')
+                {
+                    throw "Regex error: unmatched (";
+                }
+                pos_++;
+                return inner;
+            }
+            case '[':
+                return ast_.add_set(parse_class());
+            case '.':
+            {
+                ByteSet set;
+                set.set();
+                set.reset('\n');
+                return ast_.add_set(set);
+            }
+            case '^':
+                return ast_.add(Node{NodeKind::line_start});
+            case '$':
+                return ast_.add(Node{NodeKind::line_end});
+            case '\\':
+                return ast_.add_set(parse_escape());
+            case '*':
+            case '+':
+            case '?':
+            case '{':
+                throw "Regex error: nothing to repeat";
+            default:
+            {
+                ByteSet set;
+                set.set(static_cast<unsigned char>(c));
+                return ast_.add_set(set);
+            }
+            }
+        }
+
+        // After a '\'
+        ByteSet parse_escape()
+        {
+            if (at_end())
+            {
+                throw "Regex error: trailing \\";
+            }
+            char c = peek();
+            pos_++;
+            ByteSet set;
+            switch (c)
+            {
+            case 'd':
+            case 'D':
+                for (int b = '0'; b <= '9'; b++)
+                    set.set(b);
+                break;
+            case 'w':
+            case 'W':
+                for (int b = 0; b < 256; b++)
+                    if ((b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || (b >= '0' && b <= '9') || b == '_')
+                        set.set(b);
+                break;
+            case 's':
+            case 'S':
+                for (char b : {' ', '\t', '\n', '\r', '\f', '\v'})
+                    set.set(static_cast<unsigned char>(b));
+                break;
+            case 'n':
+                set.set('\n');
+                return set;
+            case 't':
+                set.set('\t');
+                return set;
+            case 'r':
+                set.set('\r');
+                return set;
+            case 'f':
+                set.set('\f');
+                return set;
+            case 'v':
+                set.set('\v');
+                return set;
+            default:
+                if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+                {
+                    throw "Regex error: unknown escape";
+                }
+                set.set(static_cast<unsigned char>(c));
+                return set;
+            }
+            return c >= 'A' && c <= 'Z' ? ~set : set;
+        }
+
+        // After a '[', up to and including the ']'. A ']' right after the
+        // '[' (or '[^') is a literal.
+        ByteSet parse_class()
+        {
+            ByteSet set;
+            bool negated = !at_end() && peek() == '^';
+            if (negated)
+            {
+                pos_++;
+            }
+            bool first = true;
+            while (true)
+            {
+                if (at_end())
+                {
+                    throw "Regex error: unmatched [";
+                }
+                char c = peek();
+                if (c == ']' && !first)
+                {
+                    pos_++;
+                    break;
+                }
+                first = false;
+                pos_++;
+                if (c == '\\')
+                {
+                    ByteSet escaped = parse_escape();
+                    if (escaped.count() != 1)
+                    {
+                        set |= escaped;
+                        continue;
+                    }
+                    c = static_cast<char>(first_byte(escaped));
+                }
+                // Range, unless the '-' is the last thing in the class
+                if (pos_ + 1 < pattern_.size() && peek() == '-' && pattern_[pos_ + 1] != ']')
+                {
+                    pos_++;
+                    char hi = peek();
+                    pos_++;
+                    if (hi == '\\')
+                    {
+                        ByteSet escaped = parse_escape();
+                        if (escaped.count() != 1)
+                        {
+                            throw "Regex error: bad range in class";
+                        }
+                        hi = static_cast<char>(first_byte(escaped));
+                    }
+                    if (static_cast<unsigned char>(hi) < static_cast<unsigned char>(c))
+                    {
+                        throw "Regex error: bad range in class";
+                    }
+                    for (int b = static_cast<unsigned char>(c); b <= static_cast<unsigned char>(hi); b++)
+                    {
+                        set.set(b);
+                    }
+                }
+                else
+                {
+                    set.set(static_cast<unsigned char>(c));
+                }
+            }
+            return negated ? ~set : set;
+        }
+
+        static int first_byte(const ByteSet &set)
+        {
+            for (int b = 0; b < 256; b++)
+                if (set.test(b))
+                    return b;
+            return 0;
+        }
+
+        std::string_view pattern_;
+        size_t pos_ = 0;
+        Ast &ast_;
+    };
+
+    // Thompson NFA
+
+    enum class NfaKind
+    {
+        set,        // Consumes a byte of sets_[set_], then goes to out_
+        split,      // Goes to out_ and out1_, out_ preferred
+        line_start, // Goes to out_ if at the start of a line
+        line_end,   // Goes to out_ if at the end of a line
+        match
+    };
+
+    struct NfaState
+    {
+        NfaKind kind_;
+        int set_ = 0;
+        int out_ = 0;
+        int out1_ = 0;
+    };
+
+    struct Nfa
+    {
+        std::vector<NfaState> states_;
+        int start_ = 0;
+
+        int add(NfaState state)
+        {
+            if (states_.size() >= max_nfa_states)
+            {
+                throw "Regex error: pattern too large";
+            }
+            states_.push_back(state);
+            return static_cast<int>(states_.size()) - 1;
+        }
+    };
+
+    // Compiles the subtree at node into nfa, continuing to next, and returns
+    // its first state. Reversed, concatenations go backwards and line starts
+    // and ends swap, for searching backwards.
+    int compile(Nfa &nfa, int node, int next, bool reverse)
+    {
+        const Node &n = ast_.nodes_[node];
+        switch (n.kind_)
+        {
+        case NodeKind::set:
+            return nfa.add(NfaState{NfaKind::set, n.set_, next});
+        case NodeKind::empty:
+            return next;
+        case NodeKind::concat:
+            if (reverse)
+            {
+                for (int child : n.children_)
+                    next = compile(nfa, child, next, reverse);
+            }
+            else
+            {
+                for (auto it = n.children_.rbegin(); it != n.children_.rend(); ++it)
+                    next = compile(nfa, *it, next, reverse);
+            }
+            return next;
+        case NodeKind::alternate:
+        {
+            int state = compile(nfa, n.children_.back(), next, reverse);
+            for (size_t i = n.children_.size() - 1; i-- > 0;)
+            {
+                int option = compile(nfa, n.children_[i], next, reverse);
+                state = nfa.add(NfaState{NfaKind::split, 0, option, state});
+            }
+            return state;
+        }
+        case NodeKind::line_start:
+            return nfa.add(NfaState{reverse ? NfaKind::line_end : NfaKind::line_start, 0, next});
+        case NodeKind::line_end:
+            return nfa.add(NfaState{reverse ? NfaKind::line_start : NfaKind::line_end, 0, next});
+        case NodeKind::repeat:
+        default:
+        {
+            int child = n.children_[0];
+            bool greedy = n.greedy_;
+            int max = n.max_;
+            int min = n.min_;
+            int state = next;
+            if (max == unbounded)
+            {
+                // Loop: split between another round and moving on
+                int loop = nfa.add(NfaState{NfaKind::split});
+                int body = compile(nfa, child, loop, reverse);
+                nfa.states_[loop].out_ = greedy ? body : next;
+                nfa.states_[loop].out1_ = greedy ? next : body;
+                state = loop;
+            }
+            else
+            {
+                // Nested optional copies, ie x{0,2} is (x(x)?)?
+                for (int i = min; i < max; i++)
+                {
+                    int body = compile(nfa, child, state, reverse);
+                    state = nfa.add(greedy ? NfaState{NfaKind::split, 0, body, next}
+                                           : NfaState{NfaKind::split, 0, next, body});
+                }
+            }
+            for (int i = 0; i < min; i++)
+            {
+                state = compile(nfa, child, state, reverse);
+            }
+            return state;
+        }
+        }
+    }
+
+    int any_byte()
+    {
+        ByteSet set;
+        set.set();
+        for (size_t i = 0; i < ast_.sets_.size(); i++)
+        {
+            if (ast_.sets_[i] == set)
+            {
+                return static_cast<int>(i);
+            }
+        }
+        ast_.sets_.push_back(set);
+        return static_cast<int>(ast_.sets_.size()) - 1;
+    }
+
+    // Bytes no set of the pattern tells apart share a DFA column. '\n' always
+    // gets its own, as it ends and starts lines.
+    void build_classes()
+    {
+        std::map<std::vector<bool>, int> classes;
+        for (int b = 0; b < 256; b++)
+        {
+            std::vector<bool> signature;
+            signature.reserve(ast_.sets_.size() + 1);
+            signature.push_back(b == '\n');
+            for (const ByteSet &set : ast_.sets_)
+            {
+                signature.push_back(set.test(b));
+            }
+            auto it = classes.emplace(signature, static_cast<int>(classes.size())).first;
+            class_[b] = static_cast<uint8_t>(it->second);
+            if (it->second == static_cast<int>(class_bytes_.size()))
+            {
+                class_bytes_.push_back(static_cast<unsigned char>(b));
+            }
+        }
+    }
+
+    // Lazily built DFA over one of the NFAs.
+    //
+    // A DFA state is an ordered set of NFA states, not yet followed through
+    // their epsilon transitions: whether ^ and $ hold is only known once the
+    // byte after them is seen. Its transition on a byte follows them with
+    // that byte as context, notes whether the match state was reached (a
+    // match ends right before the byte), then steps over the byte.
+    // In leftmost-first mode, NFA states after the match state in the order
+    // are dropped: they could only give less preferred matches.
+    //
+    // Without ^ in the NFA, whether at the start of a line makes no
+    // difference, so states don't record it and '\n' is like any other byte.
+    //
+    // While scanning forward from the start state, if a single byte leads out
+    // of it (as the first byte of a literal does), memchr skips to that byte.
+    class Dfa
+    {
+    public:
+        Dfa(const Nfa &nfa, const std::vector<ByteSet> &sets, const uint8_t *classes,
+            const std::vector<unsigned char> &class_bytes, bool leftmost_first, size_t cache_bytes)
+            : nfa_(nfa), sets_(sets), class_(classes), class_bytes_(class_bytes),
+              leftmost_first_(leftmost_first), cache_bytes_(std::max<size_t>(cache_bytes, 4096)),
+              seen_(nfa.states_.size(), 0)
+        {
+            line_starts_ = std::any_of(nfa.states_.begin(), nfa.states_.end(), [](const NfaState &state)
+                                       { return state.kind_ == NfaKind::line_start; });
+            reset();
+            resets_ = 0;
+        }
+
+        size_t state_count() const
+        {
+            return states_.size();
+        }
+
+        size_t resets() const
+        {
+            return resets_;
+        }
+
+        // End of the last match found scanning forward from from, until the
+        // DFA dies or the text ends, or npos if none
+        uint64_t scan_forward(std::string_view text, uint64_t from)
+        {
+            int32_t row = start(from == 0 || text[from - 1] == '\n');
+            uint64_t last = npos;
+            const unsigned char *data = reinterpret_cast<const unsigned char *>(text.data());
+            const int32_t *table = table_.data();
+            for (uint64_t i = from; i < text.size(); i++)
+            {
+                if (row == skip_row_ && skip_byte_ >= 0)
+                {
+                    const void *next = std::memchr(data + i, skip_byte_, text.size() - i);
+                    if (!next)
+                    {
+                        break;
+                    }
+                    i = static_cast<const unsigned char *>(next) - data;
+                }
+                uint8_t byte_class = class_[data[i]];
+                int32_t entry = table[row + byte_class];
+                if (entry < 0)
+                {
+                    entry = transition(row, byte_class);
+                    table = table_.data();
+                }
+                if (entry & 1)
+                {
+                    last = i;
+                }
+                row = entry >> 1;
+                if (row == dead)
+                {
+                    return last;
+                }
+            }
+            if (matches_at_end(row))
+            {
+                last = text.size();
+            }
+            return last;
+        }
+
+        // Same as scan_forward, from end down to lower, for the reversed NFA:
+        // start of the longest match found, or npos if none
+        uint64_t scan_backward(std::string_view text, uint64_t lower, uint64_t end)
+        {
+            int32_t row = start(end == text.size() || text[end] == '\n');
+            uint64_t last = npos;
+            const unsigned char *data = reinterpret_cast<const unsigned char *>(text.data());
+            const int32_t *table = table_.data();
+            for (uint64_t i = end; i > lower; i--)
+            {
+                uint8_t byte_class = class_[data[i - 1]];
+                int32_t entry = table[row + byte_class];
+                if (entry < 0)
+                {
+                    entry = transition(row, byte_class);
+                    table = table_.data();
+                }
+                if (entry & 1)
+                {
+                    last = i;
+                }
+                row = entry >> 1;
+                if (row == dead)
+                {
+                    return last;
+                }
+            }
+            // The byte before lower, if any, tells whether a match ends there
+            bool matched = lower == 0 ? matches_at_end(row) : (transition(row, class_[data[lower - 1]]) & 1);
+            return matched ? lower : last;
+        }
+
+    private:
+        static constexpr int32_t dead = 0;
+
+        struct State
+        {
+            std::vector<int> nfa_;
+            bool line_start_; // The byte before was a '\n' (or there was none)
+            int8_t matches_at_end_ = -1;
+        };
+
+        void reset()
+        {
+            states_.clear();
+            index_.clear();
+            table_.clear();
+            bytes_ = 0;
+            resets_++;
+            add_state({}, false); // dead
+            start_[0] = start_[1] = -1;
+            skip_row_ = -1;
+            skip_byte_ = -1;
+        }
+
+        int32_t start(bool line_start)
+        {
+            if (start_[line_start] < 0)
+            {
+                int32_t row = add_state({nfa_.start_}, line_start);
+                start_[line_start] = row;
+                // Only past the start of a line can the state go back to itself
+                const State &state = states_[row / class_bytes_.size()];
+                if (!state.line_start_)
+                {
+                    skip_row_ = row;
+                    skip_byte_ = skip_byte(state);
+                }
+            }
+            return start_[line_start];
+        }
+
+        // Row of the state for this set of NFA states, adding it if needed.
+        // When the cache is full, it's cleared first, and then the state is
+        // added even if it alone is over budget.
+        int32_t add_state(std::vector<int> nfa, bool line_start)
+        {
+            line_start = line_start && line_starts_;
+            std::string key(1, nfa.empty() ? 0 : line_start ? 1 : 2);
+            key.append(reinterpret_cast<const char *>(nfa.data()), nfa.size() * sizeof(int));
+            auto it = index_.find(key);
+            if (it != index_.end())
+            {
+                return it->second;
+            }
+
+            size_t cost = class_bytes_.size() * sizeof(int32_t) + 2 * key.size() + sizeof(State) + 64;
+            // Beyond the dead state, which is all a reset leaves
+            if (states_.size() > 1 && bytes_ + cost > cache_bytes_)
+            {
+                reset();
+            }
+            bytes_ += cost;
+            int32_t row = static_cast<int32_t>(table_.size());
+            states_.push_back(State{std::move(nfa), line_start});
+            index_.emplace(std::move(key), row);
+            table_.resize(table_.size() + class_bytes_.size(), -1);
+            return row;
+        }
+
+        // Appends the NFA states reachable from state without consuming
+        // input, given whether at the start and end of a line, to out, in
+        // order of preference. Returns true if the match state was reached.
+        bool closure(int state, bool line_start, bool line_end, std::vector<int> &out)
+        {
+            stack_.clear();
+            stack_.push_back(state);
+            bool matched = false;
+            while (!stack_.empty())
+            {
+                int s = stack_.back();
+                stack_.pop_back();
+                if (seen_[s] == generation_)
+                {
+                    continue;
+                }
+                seen_[s] = generation_;
+                const NfaState &n = nfa_.states_[s];
+                switch (n.kind_)
+                {
+                case NfaKind::split:
+                    stack_.push_back(n.out1_);
+                    stack_.push_back(n.out_);
+                    break;
+                case NfaKind::line_start:
+                    if (line_start)
+                        stack_.push_back(n.out_);
+                    break;
+                case NfaKind::line_end:
+                    if (line_end)
+                        stack_.push_back(n.out_);
+                    break;
+                case NfaKind::match:
+                    matched = true;
+                    if (leftmost_first_)
+                    {
+                        return true;
+                    }
+                    break;
+                case NfaKind::set:
+                    out.push_back(s);
+                    break;
+                }
+            }
+            return matched;
+        }
+
+        // Follows every state of set, in order, through epsilon transitions.
+        // Returns true if a match was reached.
+        bool close(const State &state, bool line_end, std::vector<int> &out)
+        {
+            next_generation();
+            bool matched = false;
+            for (int s : state.nfa_)
+            {
+                if (closure(s, state.line_start_, line_end, out))
+                {
+                    matched = true;
+                    if (leftmost_first_)
+                    {
+                        break;
+                    }
+                }
+            }
+            return matched;
+        }
+
+        bool matches_at_end(int32_t row)
+        {
+            State &state = states_[row / class_bytes_.size()];
+            if (state.matches_at_end_ < 0)
+            {
+                closed_.clear();
+                state.matches_at_end_ = close(state, true, closed_);
+            }
+            return state.matches_at_end_;
+        }
+
+        // Computes (and caches) the transition of the state at row on a byte
+        // class: the next state's row, shifted left, plus 1 if a match ends
+        // before the byte
+        int32_t transition(int32_t row, uint8_t byte_class)
+        {
+            size_t slot = row + byte_class;
+            if (table_[slot] >= 0)
+            {
+                return table_[slot];
+            }
+
+            unsigned char byte = class_bytes_[byte_class];
+            std::vector<int> next;
+            bool matched = step(states_[row / class_bytes_.size()], byte, next);
+
+            size_t resets = resets_;
+            int32_t next_row = add_state(std::move(next), byte == '\n');
+            int32_t entry = next_row << 1 | (matched ? 1 : 0);
+            if (resets == resets_)
+            {
+                table_[slot] = entry;
+            }
+            return entry;
+        }
+
+        // Appends the NFA states state goes to on byte to next. Returns true
+        // if a match ends before the byte.
+        bool step(const State &state, unsigned char byte, std::vector<int> &next)
+        {
+            closed_.clear();
+            bool matched = close(state, byte == '\n', closed_);
+            next_generation();
+            for (int s : closed_)
+            {
+                const NfaState &n = nfa_.states_[s];
+                if (sets_[n.set_].test(byte) && seen_[n.out_] != generation_)
+                {
+                    seen_[n.out_] = generation_;
+                    next.push_back(n.out_);
+                }
+            }
+            return matched;
+        }
+
+        // The one byte on which state doesn't go back to itself without a
+        // match, or -1 if there are several
+        int skip_byte(const State &state)
+        {
+            int skip = -1;
+            std::vector<int> next;
+            for (size_t c = 0; c < class_bytes_.size(); c++)
+            {
+                unsigned char byte = class_bytes_[c];
+                next.clear();
+                bool matched = step(state, byte, next);
+                if (!matched && next == state.nfa_ && (byte == '\n' && line_starts_) == state.line_start_)
+                {
+                    continue;
+                }
+                if (skip >= 0 || std::count(class_, class_ + 256, c) != 1)
+                {
+                    return -1;
+                }
+                skip = byte;
+            }
+            return skip;
+        }
+
+        void next_generation()
+        {
+            if (++generation_ == 0)
+            {
+                std::fill(seen_.begin(), seen_.end(), 0);
+                generation_ = 1;
+            }
+        }
+
+        const Nfa &nfa_;
+        const std::vector<ByteSet> &sets_;
+        const uint8_t *class_;
+        const std::vector<unsigned char> &class_bytes_; // A byte of each class
+        bool leftmost_first_;
+        size_t cache_bytes_;
+        bool line_starts_; // The NFA has a ^
+
+        std::vector<State> states_;
+        std::unordered_map<std::string, int32_t> index_;
+        // Transition per state and class, -1 if not computed yet. A state is
+        // known by the offset of its row, so scanning needs no multiply.
+        std::vector<int32_t> table_;
+        size_t bytes_ = 0;
+        size_t resets_ = 0;
+        int32_t start_[2]; // Start state rows, by line_start, -1 until needed
+        int32_t skip_row_;  // Row of the start state past a line start while it's cached, else -1
+        int skip_byte_;     // Its skip_byte(), if it has one
+
+        // Scratch space for closures
+        std::vector<uint32_t> seen_;
+        uint32_t generation_ = 0;
+        std::vector<int> stack_;
+        std::vector<int> closed_;
+    };
+
+    Dfa &dfa(std::unique_ptr<Dfa> &dfa, const Nfa &nfa, bool leftmost_first)
+    {
+        if (!dfa)
+        {
+            dfa = std::make_unique<Dfa>(nfa, ast_.sets_, class_, class_bytes_, leftmost_first, cache_bytes_);
+        }
+        return *dfa;
+    }
+
+    Ast ast_;
+    int root_ = 0;
+    uint8_t class_[256];
+    std::vector<unsigned char> class_bytes_;
+    size_t cache_bytes_;
+
+    Nfa forward_;
+    Nfa backward_;
+    Nfa anchored_; // Built on first full_match()
+    std::unique_ptr<Dfa> forward_dfa_;
+    std::unique_ptr<Dfa> backward_dfa_;
+    std::unique_ptr<Dfa> anchored_dfa_;
+};
@@ -0,0 +1,166 @@
+/*
+Regular expression search with a lazily built DFA (Regex), compared with the
+literal matchers on the same text.
+
+Usage: regex_search [text MiB] [seed]
+
+Checks the first match of Regex against std::regex on small cases, including
+those where they're known to differ. Then searches log-like lines (default
+64 MiB) for literal patterns with Regex, SimdSearcher and KMP, checking they
+find the same matches, then for patterns only Regex can express, a pattern
+whose DFA overflows a small cache, and a pattern that makes backtracking
+engines take exponential time.
+ */
+
+#include "kmp.hpp"
+#include "regex.hpp"
+#include "simd_search.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <regex>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void row(const std::string &name, size_t bytes, double seconds, uint64_t matches)
+{
+    std::cout << "  " << std::left << std::setw(32) << name << std::right << std::setw(10) << std::setprecision(3)
+              << bytes / seconds / (1 << 20) << std::setw(12) << matches << std::endl;
+}
+
+// Regex row, with the DFA cache state after the search
+uint64_t regex_row(const std::string &pattern, std::string_view text, size_t cache_bytes = size_t(2) << 20)
+{
+    Regex regex(pattern, cache_bytes);
+    auto start = Clock::now();
+    uint64_t matches = regex.count(text);
+    row("regex " + pattern, text.size(), seconds_since(start), matches);
+    std::cout << "  " << std::setw(32) << "" << "  (" << regex.dfa_states() << " DFA states, "
+              << regex.cache_resets() << " cache resets)" << std::endl;
+    return matches;
+}
+
+// Whether Regex and std::regex find the same first match (or none) as
+// expected: they differ where a repeated group matches empty (see regex.hpp)
+bool agrees_with_std(const char *pattern, const char *text, bool same)
+{
+    Regex regex(pattern);
+    Regex::Match match{0, 0};
+    bool found = regex.find(text, match);
+
+    std::cmatch std_match;
+    bool std_found = std::regex_search(text, std_match, std::regex(pattern, std::regex::ECMAScript | std::regex::multiline));
+    uint64_t std_begin = std_found ? std_match.position(0) : 0;
+    uint64_t std_end = std_found ? std_begin + std_match.length(0) : 0;
+
+    bool equal = found == std_found && match.begin_ == std_begin && match.end_ == std_end;
+    if (equal != same)
+    {
+        std::cout << "  " << pattern << " on \"" << text << "\": [" << match.begin_ << ", " << match.end_
+                  << "), std::regex [" << std_begin << ", " << std_end << ")" << std::endl;
+    }
+    return equal == same;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t mib = argc > 1 ? std::stoul(argv[1]) : 64;
+    unsigned long seed = argc > 2 ? std::stoul(argv[2]) : 1;
+
+    std::mt19937_64 rng(seed);
+    static const char *levels[] = {"INFO: ", "DEBUG: ", "WARNING: ", "ERROR: "};
+    std::string text;
+    while (text.size() < mib << 20)
+    {
+        text += levels[rng() % 4];
+        text += "request " + std::to_string(rng() % 100000) + " took " + std::to_string(rng() % 1000) + "ms\n";
+    }
+    std::cout << "Text: " << text.size() << " bytes" << std::endl;
+    std::cout << "  " << std::left << std::setw(32) << "" << std::right << std::setw(10) << "MiB/s" << std::setw(12)
+              << "matches" << std::endl;
+
+    // Literals have no self-overlap, so every matcher counts the same
+    bool agree = true;
+    struct Case
+    {
+        const char *pattern_;
+        const char *text_;
+        bool same_;
+    };
+    static const Case cases[] = {
+        {"(a|ab)(c|bcd)(d*)", "abcd", true},
+        {"a*?b|a+", "aaab", true},
+        {"(a+|b)*?c", "abbac", true},
+        {"(a?)+b", "aab", true},
+        {"^took|ms$", "took 12ms\nms", true},
+        {"\\d+ took", "request 42 took", true},
+        {"(a?\?)+", "aab", false},
+        {"(a*?)*", "aab", false},
+        {"(.{0,2}?)+", "bccaaca", false},
+    };
+    for (const Case &c : cases)
+    {
+        agree = agrees_with_std(c.pattern_, c.text_, c.same_) && agree;
+    }
+
+    for (std::string literal : {"ERROR", "request 4242 "})
+    {
+        uint64_t regex_matches = regex_row(literal, text);
+
+        SimdSearcher searcher(literal);
+        auto start = Clock::now();
+        uint64_t simd_matches = searcher.count(text);
+        row("simd " + literal, text.size(), seconds_since(start), simd_matches);
+
+        std::vector<int> f = calculate_failure_function(literal);
+        start = Clock::now();
+        uint64_t kmp_matches = 0;
+        for_each_match_kmp(text, literal, f, 0, [&kmp_matches](uint64_t)
+                           { kmp_matches++;
+                             return true; });
+        row("kmp " + literal, text.size(), seconds_since(start), kmp_matches);
+
+        agree = agree && regex_matches == simd_matches && regex_matches == kmp_matches;
+    }
+
+    for (std::string pattern : {"^(ERROR|WARNING): ", "took [0-9]{3}ms$", "request \\d*7 took 9\\d\\dms", "[A-Z]+: r"})
+    {
+        regex_row(pattern, text);
+    }
+
+    // Lines of random bits with a 1 thirteen bytes before their end: the DFA
+    // has to remember the last 13 bits, 8192 states, so a small cache keeps
+    // resetting
+    std::string bits(4 << 20, '0');
+    for (size_t i = 0; i < bits.size(); i++)
+    {
+        bits[i] = i % 64 == 63 ? '\n' : "01"[rng() % 2];
+    }
+    std::string pattern = "1[01]{12}$";
+    std::cout << "Random bits (" << bits.size() << " bytes), " << pattern << std::endl;
+    uint64_t large = regex_row(pattern, bits);
+    uint64_t small = regex_row(pattern, bits, 64 << 10);
+    agree = agree && large == small;
+
+    // Backtracking tries every way to split the x's between the two x+
+    std::string xs(1 << 20, 'x');
+    pattern = "(x+x+)+y";
+    std::cout << "No match in x's (" << xs.size() << " bytes), " << pattern << std::endl;
+    regex_row(pattern, xs);
+
+    if (!agree)
+    {
+        std::cout << "Matches DIFFER" << std::endl;
+        return -1;
+    }
+    std::cout << "Matches agree" << std::endl;
+}
@@ -0,0 +1,117 @@
+/*
+Vectorized substring search, compared with KMP and std::string_view::find.
+
+Usage: simd_search [text MiB] [seed]
+
+Searches a few patterns in a random English-like text (default 64 MiB), then
+in an adversarial one (a single repeated byte), checking that every method
+finds the same number of matches.
+ */
+
+#include "kmp.hpp"
+#include "simd_search.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Words drawn with skewed frequencies, like in real text
+std::string english_like_text(size_t bytes, unsigned long seed)
+{
+    static const char *words[] = {
+        "the", "of", "and", "to", "in", "a", "is", "that", "for", "it", "as", "was", "with", "be", "by",
+        "on", "not", "he", "this", "are", "or", "his", "from", "at", "which", "but", "have", "an", "had",
+        "they", "you", "were", "their", "one", "all", "we", "can", "her", "has", "there", "been", "if",
+        "more", "when", "will", "would", "who", "so", "no", "compiler", "grammar", "token", "parser",
+        "expression", "automaton", "string", "matching", "performance", "engineering", "memory"};
+    constexpr size_t word_count = sizeof(words) / sizeof(words[0]);
+
+    std::mt19937_64 rng(seed);
+    std::geometric_distribution<size_t> rank(0.08);
+    std::string text;
+    text.reserve(bytes + 32);
+    size_t sentence = 0;
+    while (text.size() < bytes)
+    {
+        text += words[rank(rng) % word_count];
+        text += ++sentence % 12 == 0 ? ".\n" : " ";
+    }
+    return text;
+}
+
+void row(const std::string &name, double seconds, uint64_t matches, size_t bytes)
+{
+    std::cout << "  " << std::left << std::setw(14) << name << std::right << std::setw(12) << std::fixed
+              << std::setprecision(4) << seconds << std::setw(12) << std::setprecision(2)
+              << bytes / seconds / 1e9 << std::setw(12) << matches << std::endl;
+    std::cout << std::defaultfloat;
+}
+
+void compare(std::string_view text, const std::string &pattern)
+{
+    std::cout << "Pattern \"" << (pattern.size() > 40 ? pattern.substr(0, 37) + "..." : pattern) << "\" ("
+              << pattern.size() << " bytes)" << std::endl;
+    std::cout << "  " << std::left << std::setw(14) << "" << std::right << std::setw(12) << "time (s)"
+              << std::setw(12) << "GB/s" << std::setw(12) << "matches" << std::endl;
+
+    auto start = Clock::now();
+    std::vector<int> f = calculate_failure_function(pattern);
+    uint64_t kmp = 0;
+    for_each_match_kmp(text, pattern, f, 0, [&kmp](uint64_t)
+                       { kmp++;
+                         return true; });
+    row("kmp", seconds_since(start), kmp, text.size());
+
+    start = Clock::now();
+    uint64_t find = 0;
+    for (size_t at = text.find(pattern); at != std::string_view::npos; at = text.find(pattern, at + 1))
+    {
+        find++;
+    }
+    row("string::find", seconds_since(start), find, text.size());
+
+    start = Clock::now();
+    SimdSearcher searcher(pattern);
+    uint64_t simd = searcher.count(text);
+    row(searcher.isa(), seconds_since(start), simd, text.size());
+
+    start = Clock::now();
+    uint64_t first = searcher.find_first(text);
+    std::cout << "  first match at " << (first == SimdSearcher::npos ? std::string("none") : std::to_string(first))
+              << " (" << seconds_since(start) << " s)" << std::endl;
+    if (kmp != simd || find != simd)
+    {
+        std::cout << "  Counts DIFFER" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    size_t mib = argc > 1 ? std::stoul(argv[1]) : 64;
+    unsigned long seed = argc > 2 ? std::stoul(argv[2]) : 1;
+
+    std::string text = english_like_text(mib << 20, seed);
+    std::cout << "English-like text, " << text.size() << " bytes" << std::endl;
+    compare(text, "the");
+    compare(text, "compiler");
+    compare(text, "performance engineering");
+    compare(text, "string matching automaton");
+
+    // Every position is a candidate, and only fails near the end of the pattern
+    std::string adversarial(mib << 20, 'a');
+    std::cout << std::endl
+              << "Adversarial text, " << adversarial.size() << " bytes" << std::endl;
+    compare(adversarial, std::string(62, 'a') + "ba");
+    compare(adversarial, std::string(64, 'a'));
+}
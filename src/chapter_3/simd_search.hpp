@@ -0,0 +1,251 @@
+#pragma once
+
+#include "kmp.hpp"
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <immintrin.h>
+#define SIMD_SEARCH_SSE2 1
+#else
+#define SIMD_SEARCH_SSE2 0
+#endif
+
+// AVX2 is picked at runtime, which needs per-function target attributes
+#if SIMD_SEARCH_SSE2 && (defined(__GNUC__) || defined(__clang__))
+#define SIMD_SEARCH_AVX2 1
+#else
+#define SIMD_SEARCH_AVX2 0
+#endif
+
+// Substring search, 16 or 32 positions at a time.
+//
+// Candidate positions are those where both the first and the last byte of
+// the pattern match, found with two vector compares per block of text; only
+// those are then checked in full, 16 bytes at a time. On most text, few
+// positions get past the filter, so search runs at memory speed.
+//
+// Some inputs (ie long runs of the same byte) make nearly every position a
+// candidate, and verification quadratic. When verifying costs more than a
+// few bytes per byte of text, the rest of the text is searched with KMP
+// instead, which stays linear. KMP also searches the last few positions,
+// too close to the end for a whole block, and everything on CPUs without
+// SSE2.
+//
+// Matches may overlap. Offsets are 64-bit, so texts can be larger than 4GiB.
+class SimdSearcher
+{
+public:
+    static constexpr uint64_t npos = ~uint64_t(0);
+
+    // An empty pattern never matches
+    explicit SimdSearcher(std::string pattern)
+        : pattern_(std::move(pattern)), failure_(calculate_failure_function(pattern_))
+    {
+#if SIMD_SEARCH_AVX2
+        avx2_ = __builtin_cpu_supports("avx2");
+#endif
+    }
+
+    // Instruction set used by searches: "avx2", "sse2" or "kmp"
+    const char *isa() const
+    {
+        return avx2_ ? "avx2" : SIMD_SEARCH_SSE2 ? "sse2"
+                                                 : "kmp";
+    }
+
+    // Offset of the first occurrence at or after from, or npos if none
+    uint64_t find_first(std::string_view text, uint64_t from = 0) const
+    {
+        uint64_t found = npos;
+        search(text, from, [&found](uint64_t offset)
+               { found = offset;
+                 return false; });
+        return found;
+    }
+
+    uint64_t count(std::string_view text) const
+    {
+        uint64_t n = 0;
+        search(text, 0, [&n](uint64_t)
+               { n++;
+                 return true; });
+        return n;
+    }
+
+    // Calls on_match(offset) for every occurrence, in order
+    template <typename F>
+    void for_each(std::string_view text, F &&on_match) const
+    {
+        search(text, 0, [&on_match](uint64_t offset)
+               { on_match(offset);
+                 return true; });
+    }
+
+    std::vector<uint64_t> find_all(std::string_view text) const
+    {
+        std::vector<uint64_t> matches;
+        for_each(text, [&matches](uint64_t offset)
+                 { matches.push_back(offset); });
+        return matches;
+    }
+
+private:
+    // Bytes verified per byte of text past which search falls back to KMP,
+    // after some slack so a few unlucky blocks don't trigger it
+    static constexpr uint64_t max_verify_ratio = 4;
+    static constexpr uint64_t verify_slack = 4096;
+
+    // Calls on_match(offset) for occurrences at or after from, until it
+    // returns false. Returns false if it did.
+    template <typename F>
+    bool search(std::string_view text, uint64_t from, F &&on_match) const
+    {
+        size_t m = pattern_.size();
+        if (m == 0 || text.size() < m || from > text.size() - m)
+        {
+            return true;
+        }
+        uint64_t i = from;
+#if SIMD_SEARCH_AVX2
+        if (avx2_)
+        {
+            if (!search_avx2(text, i, on_match))
+                return false;
+        }
+        else
+#endif
+        {
+#if SIMD_SEARCH_SSE2
+            if (!search_sse2(text, i, on_match))
+                return false;
+#endif
+        }
+        // Whatever the vector loop left, up to the end
+        return for_each_match_kmp(text, pattern_, failure_, i, on_match);
+    }
+
+#if SIMD_SEARCH_SSE2
+    static unsigned int lowest_bit(uint32_t mask)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_ctz(mask);
+#else
+        unsigned int n = 0;
+        while (!(mask & 1))
+        {
+            mask >>= 1;
+            n++;
+        }
+        return n;
+#endif
+    }
+
+    // Checks the pattern against the text at candidate, whose first and last
+    // bytes are known to match. cost counts the bytes compared.
+    bool verify(const char *candidate, uint64_t &cost) const
+    {
+        const char *pattern = pattern_.data();
+        size_t k = 1;
+        size_t end = pattern_.size() - 1;
+        if (end <= k)
+        {
+            return true;
+        }
+        while (k + 16 <= end)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(candidate + k));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pattern + k));
+            cost += 16;
+            if (_mm_movemask_epi8(_mm_cmpeq_epi8(a, b)) != 0xFFFF)
+            {
+                return false;
+            }
+            k += 16;
+        }
+        cost += end - k;
+        return std::memcmp(candidate + k, pattern + k, end - k) == 0;
+    }
+
+    // Searches blocks of 16 positions starting at i, while both loads stay
+    // in the text, or until verifying gets too costly. Leaves i at the first
+    // position not searched.
+    template <typename F>
+    bool search_sse2(std::string_view text, uint64_t &i, F &on_match) const
+    {
+        const char *s = text.data();
+        const size_t m = pattern_.size();
+        const uint64_t end = text.size() - m + 1; // One past the last possible match
+        const __m128i first = _mm_set1_epi8(pattern_[0]);
+        const __m128i last = _mm_set1_epi8(pattern_[m - 1]);
+        const uint64_t start = i;
+        uint64_t cost = 0;
+        while (i + 16 <= end)
+        {
+            __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i));
+            __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i *>(s + i + m - 1));
+            uint32_t mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+            while (mask)
+            {
+                unsigned int bit = lowest_bit(mask);
+                if (verify(s + i + bit, cost) && !on_match(i + bit))
+                {
+                    return false;
+                }
+                mask &= mask - 1;
+            }
+            i += 16;
+            if (cost > max_verify_ratio * (i - start) + verify_slack)
+            {
+                break;
+            }
+        }
+        return true;
+    }
+#endif
+
+#if SIMD_SEARCH_AVX2
+    // Same as search_sse2, 32 positions at a time
+    template <typename F>
+    __attribute__((target("avx2"))) bool search_avx2(std::string_view text, uint64_t &i, F &on_match) const
+    {
+        const char *s = text.data();
+        const size_t m = pattern_.size();
+        const uint64_t end = text.size() - m + 1;
+        const __m256i first = _mm256_set1_epi8(pattern_[0]);
+        const __m256i last = _mm256_set1_epi8(pattern_[m - 1]);
+        const uint64_t start = i;
+        uint64_t cost = 0;
+        while (i + 32 <= end)
+        {
+            __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i));
+            __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(s + i + m - 1));
+            uint32_t mask = static_cast<uint32_t>(
+                _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, first), _mm256_cmpeq_epi8(b, last))));
+            while (mask)
+            {
+                unsigned int bit = lowest_bit(mask);
+                if (verify(s + i + bit, cost) && !on_match(i + bit))
+                {
+                    return false;
+                }
+                mask &= mask - 1;
+            }
+            i += 32;
+            if (cost > max_verify_ratio * (i - start) + verify_slack)
+            {
+                break;
+            }
+        }
+        return true;
+    }
+#endif
+
+    std::string pattern_;
+    std::vector<int> failure_;
+    bool avx2_ = false;
+};
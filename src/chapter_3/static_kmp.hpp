@@ -0,0 +1,157 @@
+#pragma once
+
+// KMP for patterns known at build time: the failure function, and the
+// matcher's tables, are computed by the C++ compiler.
+//
+//     static constexpr char needle[] = "abaa";
+//     uint64_t at = StaticKmp<needle>::find_first(text);
+//
+// Searches need no setup and never allocate, and work in constant
+// expressions too.
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Same as calculate_failure_function (see kmp.hpp), into a std::array.
+// N must be the length of str.
+template <size_t N>
+constexpr std::array<int, N> static_failure_function(const char *str)
+{
+    std::array<int, N> f{};
+    int x = 0;
+    for (size_t y = 1; y < N; y++)
+    {
+        // Find longest prefix that is also a postfix
+        while (x > 0 && str[y] != str[x])
+        {
+            x = f[x - 1];
+        }
+        if (str[y] == str[x])
+        {
+            x = x + 1;
+            f[y] = x;
+        }
+        else
+        {
+            f[y] = 0;
+        }
+    }
+    return f;
+}
+
+// Matcher for the null-terminated string Pattern, which must have static
+// storage (ie a static constexpr char array).
+//
+// The failure function is unrolled into the whole KMP automaton: for each
+// state (length of the pattern prefix matched so far) and each byte, the
+// next state. Scanning is then one table lookup per byte, with no failure
+// chain to follow, and while nothing is matched, memchr skips to the next
+// byte that can start a match. Tables take (length + 1) * 256 states, so
+// this is meant for short patterns.
+template <const char *Pattern>
+class StaticKmp
+{
+public:
+    static constexpr size_t size = std::char_traits<char>::length(Pattern);
+    static constexpr uint64_t npos = ~uint64_t(0);
+
+    static_assert(size < 65535, "Pattern too long for StaticKmp");
+
+    using State = std::conditional_t<(size < 255), uint8_t, uint16_t>;
+
+    static constexpr std::array<int, size> failure = static_failure_function<size>(Pattern);
+
+    // Offset of the first occurrence at or after from, or npos if none
+    static constexpr uint64_t find_first(std::string_view text, uint64_t from = 0)
+    {
+        uint64_t found = npos;
+        search(text, from, [&found](uint64_t offset)
+               { found = offset;
+                 return false; });
+        return found;
+    }
+
+    static constexpr uint64_t count(std::string_view text)
+    {
+        uint64_t n = 0;
+        search(text, 0, [&n](uint64_t)
+               { n++;
+                 return true; });
+        return n;
+    }
+
+    // Calls on_match(offset) for every occurrence, overlapping ones included
+    template <typename F>
+    static constexpr void for_each(std::string_view text, F &&on_match)
+    {
+        search(text, 0, [&on_match](uint64_t offset)
+               { on_match(offset);
+                 return true; });
+    }
+
+private:
+    using Transitions = std::array<std::array<State, 256>, size + 1>;
+
+    static constexpr Transitions build_transitions()
+    {
+        Transitions delta{};
+        for (size_t s = 0; s <= size; s++)
+        {
+            for (size_t c = 0; c < 256; c++)
+            {
+                if (s < size && static_cast<unsigned char>(Pattern[s]) == c)
+                {
+                    delta[s][c] = static_cast<State>(s + 1);
+                }
+                else if (s > 0)
+                {
+                    // Same as the longest proper prefix that's also a suffix
+                    delta[s][c] = delta[failure[s - 1]][c];
+                }
+            }
+        }
+        return delta;
+    }
+
+    static constexpr Transitions transitions = build_transitions();
+
+    template <typename F>
+    static constexpr bool search(std::string_view text, uint64_t from, F &&on_match)
+    {
+        if (size == 0)
+        {
+            return true;
+        }
+        State s = 0;
+        for (uint64_t i = from; i < text.size(); i++)
+        {
+            if (s == 0 && !is_constant_evaluated())
+            {
+                const void *next = std::memchr(text.data() + i, Pattern[0], text.size() - i);
+                if (!next)
+                    break;
+                i = static_cast<const char *>(next) - text.data();
+            }
+            s = transitions[s][static_cast<unsigned char>(text[i])];
+            if (s == size && !on_match(i + 1 - size))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // memchr can't run at compile time. Without the builtin, it's never used.
+    static constexpr bool is_constant_evaluated()
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return __builtin_is_constant_evaluated();
+#else
+        return true;
+#endif
+    }
+};
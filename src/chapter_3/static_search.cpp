@@ -0,0 +1,107 @@
+/*
+Fixed-pattern search with tables built at compile time (StaticKmp), compared
+with KMP building its failure function at runtime.
+
+Usage: static_search [lines] [seed]
+
+Searches a pattern in many short lines (default 1000000), where runtime setup
+dominates, then in one long text, checking both find the same matches.
+ */
+
+#include "kmp.hpp"
+#include "static_kmp.hpp"
+
+#include <chrono>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+using Clock = std::chrono::steady_clock;
+
+static constexpr char pattern[] = "ERROR:";
+using Matcher = StaticKmp<pattern>;
+
+// Everything about the matcher is known before the program runs
+static_assert(Matcher::failure[5] == 0, "ERROR: has no proper prefix that's also a suffix");
+static_assert(Matcher::count("ERROR: ERROR:ERROR") == 2, "constexpr KMP disagrees with the runtime one");
+
+double seconds_since(Clock::time_point start)
+{
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+void row(const char *name, double seconds, uint64_t matches)
+{
+    std::cout << "  " << std::left << std::setw(16) << name << std::right << std::setw(12) << seconds
+              << std::setw(12) << matches << std::endl;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t line_count = argc > 1 ? std::stoul(argv[1]) : 1000000;
+    unsigned long seed = argc > 2 ? std::stoul(argv[2]) : 1;
+
+    // Log-like lines, some of them errors
+    std::mt19937_64 rng(seed);
+    static const char *levels[] = {"INFO: ", "DEBUG: ", "WARNING: ", "ERROR: "};
+    std::vector<std::string> lines(line_count);
+    for (auto &line : lines)
+    {
+        line = levels[rng() % 4];
+        line += "request " + std::to_string(rng() % 100000) + " took " + std::to_string(rng() % 1000) + "ms";
+    }
+
+    std::cout << "Short lines (" << line_count << ")" << std::endl;
+    std::cout << "  " << std::left << std::setw(16) << "" << std::right << std::setw(12) << "time (s)"
+              << std::setw(12) << "matches" << std::endl;
+
+    // As each line would be searched on its own, without reusing state
+    auto start = Clock::now();
+    uint64_t runtime_matches = 0;
+    for (auto &line : lines)
+    {
+        std::string needle = pattern;
+        std::vector<int> f = calculate_failure_function(needle);
+        for_each_match_kmp(line, needle, f, 0, [&runtime_matches](uint64_t)
+                           { runtime_matches++;
+                             return true; });
+    }
+    row("runtime kmp", seconds_since(start), runtime_matches);
+
+    start = Clock::now();
+    uint64_t static_matches = 0;
+    for (auto &line : lines)
+    {
+        static_matches += Matcher::count(line);
+    }
+    row("StaticKmp", seconds_since(start), static_matches);
+
+    std::string text;
+    for (auto &line : lines)
+    {
+        text += line;
+        text += '\n';
+    }
+    std::cout << "One text (" << text.size() << " bytes)" << std::endl;
+
+    start = Clock::now();
+    std::vector<int> f = calculate_failure_function(pattern);
+    uint64_t runtime_text_matches = 0;
+    for_each_match_kmp(text, pattern, f, 0, [&runtime_text_matches](uint64_t)
+                       { runtime_text_matches++;
+                         return true; });
+    row("runtime kmp", seconds_since(start), runtime_text_matches);
+
+    start = Clock::now();
+    uint64_t static_text_matches = Matcher::count(text);
+    row("StaticKmp", seconds_since(start), static_text_matches);
+
+    if (runtime_matches != static_matches || runtime_text_matches != static_text_matches)
+    {
+        std::cout << "Matches DIFFER" << std::endl;
+        return -1;
+    }
+    std::cout << "Matches agree" << std::endl;
+}
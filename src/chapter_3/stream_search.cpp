@@ -0,0 +1,156 @@
+/*
+Finds every occurrence of a pattern in a file or stream of any size, with
+KMP, in constant memory.
+
+Usage: stream_search <pattern> [file, or - for stdin] [--count] [--read]
+
+Prints the byte offset of each match (or only how many there are, with
+--count), then the amount of input and throughput on stderr. Regular files
+are mapped a window at a time, everything else (or everything, with --read)
+is read through a fixed buffer.
+ */
+
+#include "kmp_stream.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Bytes mapped at once. Windows are unmapped as soon as they're searched, so
+// only this much of the file is ever mapped.
+constexpr size_t window_size = size_t(64) << 20;
+
+// Bytes per read() when the input can't be mapped
+constexpr size_t buffer_size = size_t(1) << 20;
+
+// Feeds a regular file to the matcher, one mapped window at a time.
+// Returns false on error.
+template <typename F>
+bool search_mapped(int fd, uint64_t size, StreamingKmp &matcher, F &on_match)
+{
+    for (uint64_t offset = 0; offset < size; offset += window_size)
+    {
+        size_t length = static_cast<size_t>(std::min<uint64_t>(window_size, size - offset));
+        void *window = ::mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, static_cast<off_t>(offset));
+        if (window == MAP_FAILED)
+        {
+            return false;
+        }
+        ::madvise(window, length, MADV_SEQUENTIAL);
+        matcher.feed(std::string_view(static_cast<const char *>(window), length), on_match);
+        ::munmap(window, length);
+    }
+    return true;
+}
+
+// Feeds whatever fd gives (a pipe, stdin, ...) to the matcher, until end of
+// file. Returns false on error.
+template <typename F>
+bool search_read(int fd, StreamingKmp &matcher, F &on_match)
+{
+    std::vector<char> buffer(buffer_size);
+    while (true)
+    {
+        ssize_t n = ::read(fd, buffer.data(), buffer.size());
+        if (n < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        if (n < 0)
+        {
+            return false;
+        }
+        if (n == 0)
+        {
+            return true;
+        }
+        matcher.feed(std::string_view(buffer.data(), static_cast<size_t>(n)), on_match);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string pattern;
+    std::string input = "-";
+    bool count_only = false;
+    bool force_read = false;
+    int positional = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg == "--count")
+            count_only = true;
+        else if (arg == "--read")
+            force_read = true;
+        else if (positional++ == 0)
+            pattern = arg;
+        else
+            input = arg;
+    }
+    if (positional == 0)
+    {
+        std::cout << "Usage: " << argv[0] << " <pattern> [file, or - for stdin] [--count] [--read]" << std::endl;
+        return -1;
+    }
+
+    int fd = input == "-" ? 0 : ::open(input.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        std::cout << "Can't open input file: " << input << std::endl;
+        return -1;
+    }
+
+    std::ios::sync_with_stdio(false);
+    uint64_t matches = 0;
+    auto on_match = [&matches, count_only](uint64_t offset)
+    {
+        matches++;
+        if (!count_only)
+        {
+            std::cout << offset << "\n";
+        }
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    StreamingKmp matcher(pattern);
+    struct stat st;
+    bool ok;
+    if (!force_read && ::fstat(fd, &st) == 0 && S_ISREG(st.st_mode))
+    {
+        ok = search_mapped(fd, static_cast<uint64_t>(st.st_size), matcher, on_match);
+    }
+    else
+    {
+        ok = search_read(fd, matcher, on_match);
+    }
+    int error = ok ? 0 : errno;
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (fd > 0)
+    {
+        ::close(fd);
+    }
+
+    if (count_only)
+    {
+        std::cout << matches << "\n";
+    }
+    std::cout.flush();
+    std::cerr << matcher.position() << " bytes in " << seconds << " s ("
+              << (seconds > 0 ? matcher.position() / seconds / 1e9 : 0) << " GB/s), " << matches << " matches"
+              << std::endl;
+    if (!ok)
+    {
+        std::cerr << "Error reading input file: " << input << ": " << std::strerror(error) << std::endl;
+        return -1;
+    }
+    return 0;
+}
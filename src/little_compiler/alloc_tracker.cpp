@@ -0,0 +1,156 @@
+// Replacement global operator new/delete, counting allocations per phase.
+// Only built with LITTLE_COMPILER_ALLOC_TRACKING=1 (see alloc_tracker.hpp).
+
+#include "alloc_tracker.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    // Every block is preceded by this header, so frees can be attributed to
+    // the phase that made the allocation
+    struct Header
+    {
+        uint64_t size_;
+        uint32_t offset_; // From the start of the underlying block to the user pointer
+        uint32_t phase_;
+    };
+    static_assert(sizeof(Header) == 16, "Header must keep blocks 16 byte aligned");
+
+    struct PhaseCounters
+    {
+        std::atomic<uint64_t> allocations_{0};
+        std::atomic<uint64_t> bytes_{0};
+        std::atomic<int64_t> live_bytes_{0};
+        std::atomic<int64_t> peak_live_bytes_{0};
+    };
+
+    // Zero-initialized before any dynamic initialization, so safe to use from
+    // allocations made by other static constructors
+    PhaseCounters counters_[alloc_other_phase + 1];
+    thread_local int current_phase_ = alloc_other_phase;
+
+    void *tracked_alloc(size_t size, size_t align)
+    {
+        size_t offset = align > sizeof(Header) ? align : sizeof(Header);
+        void *base;
+        if (align > sizeof(Header))
+        {
+            size_t total = (size + offset + align - 1) / align * align;
+#ifdef _WIN32
+            base = _aligned_malloc(total, align);
+#else
+            base = std::aligned_alloc(align, total);
+#endif
+        }
+        else
+        {
+            base = std::malloc(size + offset);
+        }
+        if (!base)
+        {
+            return nullptr;
+        }
+
+        char *p = static_cast<char *>(base) + offset;
+        Header *header = reinterpret_cast<Header *>(p) - 1;
+        header->size_ = size;
+        header->offset_ = static_cast<uint32_t>(offset);
+        header->phase_ = static_cast<uint32_t>(current_phase_);
+
+        PhaseCounters &c = counters_[current_phase_];
+        c.allocations_.fetch_add(1, std::memory_order_relaxed);
+        c.bytes_.fetch_add(size, std::memory_order_relaxed);
+        int64_t live = c.live_bytes_.fetch_add(size, std::memory_order_relaxed) + size;
+        int64_t peak = c.peak_live_bytes_.load(std::memory_order_relaxed);
+        while (live > peak && !c.peak_live_bytes_.compare_exchange_weak(peak, live, std::memory_order_relaxed))
+        {
+        }
+        return p;
+    }
+
+    void tracked_free(void *p)
+    {
+        if (!p)
+        {
+            return;
+        }
+        Header *header = static_cast<Header *>(p) - 1;
+        counters_[header->phase_].live_bytes_.fetch_sub(header->size_, std::memory_order_relaxed);
+
+        void *base = static_cast<char *>(p) - header->offset_;
+#ifdef _WIN32
+        if (header->offset_ > sizeof(Header))
+        {
+            _aligned_free(base);
+            return;
+        }
+#endif
+        std::free(base);
+    }
+
+    void *tracked_new(size_t size, size_t align)
+    {
+        void *p = tracked_alloc(size, align);
+        if (!p)
+        {
+            throw std::bad_alloc();
+        }
+        return p;
+    }
+}
+
+namespace alloc_tracker
+{
+    int current_phase()
+    {
+        return current_phase_;
+    }
+
+    void set_current_phase(int phase)
+    {
+        current_phase_ = phase;
+    }
+
+    AllocCounters counters(int phase)
+    {
+        PhaseCounters &c = counters_[phase];
+        AllocCounters result;
+        result.allocations_ = c.allocations_.load(std::memory_order_relaxed);
+        result.bytes_ = c.bytes_.load(std::memory_order_relaxed);
+        result.live_bytes_ = c.live_bytes_.load(std::memory_order_relaxed);
+        result.peak_live_bytes_ = c.peak_live_bytes_.load(std::memory_order_relaxed);
+        return result;
+    }
+}
+
+void *operator new(size_t size) { return tracked_new(size, 0); }
+void *operator new[](size_t size) { return tracked_new(size, 0); }
+void *operator new(size_t size, std::align_val_t align) { return tracked_new(size, static_cast<size_t>(align)); }
+void *operator new[](size_t size, std::align_val_t align) { return tracked_new(size, static_cast<size_t>(align)); }
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept { return tracked_alloc(size, 0); }
+void *operator new[](size_t size, const std::nothrow_t &) noexcept { return tracked_alloc(size, 0); }
+void *operator new(size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{
+    return tracked_alloc(size, static_cast<size_t>(align));
+}
+void *operator new[](size_t size, std::align_val_t align, const std::nothrow_t &) noexcept
+{
+    return tracked_alloc(size, static_cast<size_t>(align));
+}
+
+void operator delete(void *p) noexcept { tracked_free(p); }
+void operator delete[](void *p) noexcept { tracked_free(p); }
+void operator delete(void *p, size_t) noexcept { tracked_free(p); }
+void operator delete[](void *p, size_t) noexcept { tracked_free(p); }
+void operator delete(void *p, std::align_val_t) noexcept { tracked_free(p); }
+void operator delete[](void *p, std::align_val_t) noexcept { tracked_free(p); }
+void operator delete(void *p, size_t, std::align_val_t) noexcept { tracked_free(p); }
+void operator delete[](void *p, size_t, std::align_val_t) noexcept { tracked_free(p); }
+void operator delete(void *p, const std::nothrow_t &) noexcept { tracked_free(p); }
+void operator delete[](void *p, const std::nothrow_t &) noexcept { tracked_free(p); }
+void operator delete(void *p, std::align_val_t, const std::nothrow_t &) noexcept { tracked_free(p); }
+void operator delete[](void *p, std::align_val_t, const std::nothrow_t &) noexcept { tracked_free(p); }
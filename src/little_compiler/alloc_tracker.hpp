@@ -0,0 +1,83 @@
+#pragma once
+
+// Optional accounting of heap allocations, attributed to the phase that made
+// them (see AllocPhaseScope).
+//
+// Built with LITTLE_COMPILER_ALLOC_TRACKING=1, alloc_tracker.cpp replaces the
+// global operator new/delete to count allocations, bytes and live bytes per
+// phase. Otherwise, everything here compiles to nothing.
+
+#include "phase.hpp"
+
+#include <cstdint>
+#include <ostream>
+
+#ifndef LITTLE_COMPILER_ALLOC_TRACKING
+#define LITTLE_COMPILER_ALLOC_TRACKING 0
+#endif
+
+struct AllocCounters
+{
+    uint64_t allocations_ = 0;
+    uint64_t bytes_ = 0;      // Total requested, freed or not
+    int64_t live_bytes_ = 0;  // Allocated by this phase, and not freed yet
+    int64_t peak_live_bytes_ = 0;
+};
+
+// Allocations outside of any phase are counted under this index
+constexpr int alloc_other_phase = static_cast<int>(Phase::count);
+
+#if LITTLE_COMPILER_ALLOC_TRACKING
+
+namespace alloc_tracker
+{
+    // Phase of the calling thread, or alloc_other_phase
+    int current_phase();
+    void set_current_phase(int phase);
+
+    // Snapshot of the counters of a phase (or alloc_other_phase)
+    AllocCounters counters(int phase);
+}
+
+// Attributes the allocations of the calling thread to phase, for its lifetime
+class AllocPhaseScope
+{
+public:
+    AllocPhaseScope(Phase phase) : previous_(alloc_tracker::current_phase())
+    {
+        alloc_tracker::set_current_phase(static_cast<int>(phase));
+    }
+
+    ~AllocPhaseScope()
+    {
+        alloc_tracker::set_current_phase(previous_);
+    }
+
+private:
+    int previous_;
+};
+
+#else
+
+namespace alloc_tracker
+{
+    inline AllocCounters counters(int) { return {}; }
+}
+
+class AllocPhaseScope
+{
+public:
+    AllocPhaseScope(Phase) {}
+};
+
+#endif
+
+// Writes the counters of phase as JSON fields, ie `"allocations": 12, ...`
+inline void write_alloc_json_fields(std::ostream &out, int phase)
+{
+    AllocCounters c = alloc_tracker::counters(phase);
+    out << "\"allocations\": " << c.allocations_
+        << ", \"alloc_bytes\": " << c.bytes_
+        << ", \"live_bytes\": " << c.live_bytes_
+        << ", \"peak_live_bytes\": " << c.peak_live_bytes_;
+}
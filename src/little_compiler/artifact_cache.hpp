@@ -0,0 +1,456 @@
+#pragma once
+
+#include "binder.hpp"
+#include "budget.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#define LITTLE_GETPID _getpid
+#else
+#include <unistd.h>
+#define LITTLE_GETPID getpid
+#endif
+
+// Bump this whenever the meaning of a bound tree changes, so that stale
+// artifacts written by an older compiler are never picked up.
+constexpr const char *LITTLE_COMPILER_VERSION = "little_compiler-0.3";
+
+// Everything the front end produces for one line of input: either a bound
+// tree ready for evaluation, or the diagnostics that stopped compilation.
+// A line with nothing to evaluate (empty or comment only) has neither.
+struct Artifact
+{
+    unsigned int line_count_; // Diagnostics mention positions, so they are only valid on this line
+    std::shared_ptr<BoundNode> ast_;
+    std::string error_header_; // ie "Lexer error:"
+    std::vector<std::string> diagnostics_;
+
+    // What the front end charged against the budget, so that a hit can be
+    // held to the budget of the run loading it
+    size_t tokens_ = 0;
+    size_t depth_ = 0; // Height of the syntax tree
+    size_t nodes_ = 0;
+};
+
+// Content-addressed on-disk cache of compiled lines.
+// Artifacts are stored as one file per line, named after a hash of the
+// compiler version and the line text. Files are written to a temporary name
+// and renamed into place, so several processes can share a directory without
+// ever seeing a half-written artifact. Hits refresh the file's modification
+// time, and the oldest files are evicted first once the directory grows past
+// max_bytes.
+class ArtifactCache
+{
+public:
+    ArtifactCache(std::filesystem::path dir, std::uintmax_t max_bytes = 64u << 20)
+        : dir_(std::move(dir)), max_bytes_(max_bytes), bytes_(0), tmp_count_(0)
+    {
+        std::error_code ec;
+        std::filesystem::create_directories(dir_, ec);
+        bytes_ = scan().second;
+    }
+
+    // Returns the artifact stored for line, or nullptr on a miss. Throws
+    // BudgetExceeded, without reading the tree, if compiling the line took
+    // more than budget allows.
+    std::unique_ptr<Artifact> load(const std::string &line, unsigned int line_count,
+                                   const BudgetMeter *budget = nullptr)
+    {
+        auto path = artifact_path(line);
+        std::ifstream file(path, std::ios::binary);
+        if (!file)
+        {
+            return nullptr;
+        }
+
+        auto artifact = read_artifact(file, line, line_count, budget);
+        std::error_code ec;
+        if (!artifact)
+        {
+            // Corrupt or colliding entry, let the next store replace it
+            file.close();
+            std::filesystem::remove(path, ec);
+            return nullptr;
+        }
+        if (!artifact->diagnostics_.empty() && artifact->line_count_ != line_count)
+        {
+            // Same text on another line, the diagnostics point to the wrong place
+            return nullptr;
+        }
+
+        // Mark as recently used
+        std::filesystem::last_write_time(path, std::filesystem::file_time_type::clock::now(), ec);
+        return artifact;
+    }
+
+    void store(const std::string &line, const Artifact &artifact)
+    {
+        std::stringstream ss;
+        write_artifact(ss, line, artifact);
+        std::string data = ss.str();
+
+        // Write to a name private to this process, then publish atomically
+        auto path = artifact_path(line);
+        auto tmp = path;
+        tmp += ".tmp." + std::to_string(LITTLE_GETPID()) + "." + std::to_string(tmp_count_++);
+        {
+            std::ofstream file(tmp, std::ios::binary | std::ios::trunc);
+            if (!file.write(data.data(), data.size()))
+            {
+                std::error_code ec;
+                std::filesystem::remove(tmp, ec);
+                return;
+            }
+        }
+
+        std::error_code ec;
+        std::filesystem::rename(tmp, path, ec);
+        if (ec)
+        {
+            std::filesystem::remove(tmp, ec);
+            return;
+        }
+
+        bytes_ += data.size();
+        if (bytes_ > max_bytes_)
+        {
+            evict();
+        }
+    }
+
+    // Removes least recently used artifacts until the directory is below
+    // 90% of max_bytes. Other processes may be evicting at the same time, so
+    // files that vanish under us are simply skipped.
+    void evict()
+    {
+        auto [entries, total] = scan();
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry &a, const Entry &b)
+                  { return a.last_use_ < b.last_use_; });
+
+        std::uintmax_t target = max_bytes_ / 10 * 9;
+        for (auto &entry : entries)
+        {
+            if (total <= target)
+            {
+                break;
+            }
+            std::error_code ec;
+            if (std::filesystem::remove(entry.path_, ec))
+            {
+                total -= entry.size_;
+            }
+        }
+        bytes_ = total;
+    }
+
+private:
+    struct Entry
+    {
+        std::filesystem::path path_;
+        std::uintmax_t size_;
+        std::filesystem::file_time_type last_use_;
+    };
+
+    // Lists all artifacts in the cache directory, and sums up their size.
+    // Temporary files left behind by crashed writers are cleaned up here.
+    std::pair<std::vector<Entry>, std::uintmax_t> scan()
+    {
+        std::vector<Entry> entries;
+        std::uintmax_t total = 0;
+        auto stale = std::filesystem::file_time_type::clock::now() - std::chrono::hours(1);
+
+        std::error_code ec;
+        for (auto it = std::filesystem::directory_iterator(dir_, ec);
+             !ec && it != std::filesystem::directory_iterator(); it.increment(ec))
+        {
+            std::error_code entry_ec;
+            auto size = it->file_size(entry_ec);
+            auto time = it->last_write_time(entry_ec);
+            if (entry_ec)
+            {
+                continue;
+            }
+            if (it->path().extension() == ".lca")
+            {
+                entries.push_back({it->path(), size, time});
+                total += size;
+            }
+            else if (it->path().string().find(".lca.tmp.") != std::string::npos && time < stale)
+            {
+                std::filesystem::remove(it->path(), entry_ec);
+            }
+        }
+        return {std::move(entries), total};
+    }
+
+    // FNV-1a over the compiler version and the line text
+    static std::uint64_t hash(const std::string &line)
+    {
+        std::uint64_t h = 14695981039346656037ull;
+        auto mix = [&h](const char *s, size_t n)
+        {
+            for (size_t i = 0; i < n; i++)
+            {
+                h ^= static_cast<unsigned char>(s[i]);
+                h *= 1099511628211ull;
+            }
+        };
+        std::string version = LITTLE_COMPILER_VERSION;
+        mix(version.c_str(), version.size() + 1);
+        mix(line.data(), line.size());
+        return h;
+    }
+
+    std::filesystem::path artifact_path(const std::string &line) const
+    {
+        std::stringstream name;
+        name << std::hex;
+        name.width(16);
+        name.fill('0');
+        name << hash(line) << ".lca";
+        return dir_ / name.str();
+    }
+
+    // Artifact file layout:
+    //   <version>
+    //   <line length> <line text>     (guards against hash collisions)
+    //   <line count>
+    //   <tokens> <syntax tree height> <syntax nodes>
+    //   <error header length> <error header>
+    //   <diagnostic count>, then one "<length> <text>" per diagnostic
+    //   <bound tree in prefix order, one node per line> | "-" if none
+    //     each node starting with "<tag> <type> <column> "
+    static void write_string(std::ostream &out, const std::string &str)
+    {
+        out << str.size() << " " << str << "\n";
+    }
+
+    static bool read_string(std::istream &in, std::string &str)
+    {
+        size_t size;
+        if (!(in >> size) || in.get() != ' ')
+        {
+            return false;
+        }
+        str.resize(size);
+        return in.read(&str[0], size) && in.get() == '\n';
+    }
+
+    static void write_artifact(std::ostream &out, const std::string &line, const Artifact &artifact)
+    {
+        out << LITTLE_COMPILER_VERSION << "\n";
+        write_string(out, line);
+        out << artifact.line_count_ << "\n";
+        out << artifact.tokens_ << " " << artifact.depth_ << " " << artifact.nodes_ << "\n";
+        write_string(out, artifact.error_header_);
+        out << artifact.diagnostics_.size() << "\n";
+        for (auto &msg : artifact.diagnostics_)
+        {
+            write_string(out, msg);
+        }
+        if (artifact.ast_)
+        {
+            write_node(out, *artifact.ast_);
+        }
+        else
+        {
+            out << "-\n";
+        }
+    }
+
+    static std::unique_ptr<Artifact> read_artifact(std::istream &in, const std::string &line, unsigned int line_count,
+                                                   const BudgetMeter *budget)
+    {
+        std::string version, stored_line;
+        if (!std::getline(in, version) || version != LITTLE_COMPILER_VERSION ||
+            !read_string(in, stored_line) || stored_line != line)
+        {
+            return nullptr;
+        }
+
+        auto artifact = std::make_unique<Artifact>();
+        size_t count;
+        if (!(in >> artifact->line_count_) || in.get() != '\n' ||
+            !(in >> artifact->tokens_ >> artifact->depth_ >> artifact->nodes_) || in.get() != '\n' ||
+            !read_string(in, artifact->error_header_) || !(in >> count))
+        {
+            return nullptr;
+        }
+        if (budget)
+        {
+            budget->check_tokens(artifact->tokens_, line_count, 0);
+            budget->check_depth(artifact->depth_, line_count, 0);
+            budget->check_nodes(artifact->nodes_, line_count, 0);
+        }
+        in.get();
+        artifact->diagnostics_.resize(count);
+        for (auto &msg : artifact->diagnostics_)
+        {
+            if (!read_string(in, msg))
+            {
+                return nullptr;
+            }
+        }
+
+        if (in.peek() == '-')
+        {
+            return artifact;
+        }
+        artifact->ast_ = read_node(in, line_count, artifact->depth_);
+        if (!artifact->ast_)
+        {
+            return nullptr;
+        }
+        return artifact;
+    }
+
+    static void write_node(std::ostream &out, const BoundNode &node)
+    {
+        out << static_cast<int>(node.tag_) << " " << static_cast<int>(node.type_) << " " << node.col_ << " ";
+        switch (node.tag_)
+        {
+        case BoundExpressionTag::integer:
+            write_string(out, static_cast<const BoundIntegerExpression &>(node).value_);
+            break;
+        case BoundExpressionTag::floating:
+            write_string(out, static_cast<const BoundFloatingExpression &>(node).value_);
+            break;
+        case BoundExpressionTag::boolean:
+            write_string(out, static_cast<const BoundBooleanExpression &>(node).value_);
+            break;
+        case BoundExpressionTag::unary:
+        {
+            auto &unary = static_cast<const BoundUnaryExpression &>(node);
+            out << static_cast<int>(unary.tag_) << "\n";
+            write_node(out, *unary.expr_);
+            break;
+        }
+        case BoundExpressionTag::binary:
+        {
+            auto &binary = static_cast<const BoundBinaryExpression &>(node);
+            out << static_cast<int>(binary.tag_) << "\n";
+            write_node(out, *binary.left_);
+            write_node(out, *binary.right_);
+            break;
+        }
+        default:
+            std::cout << "Unreachable" << std::endl;
+            throw "Unreachable";
+        }
+    }
+
+    // Only columns are stored, as the same text may be loaded on another line.
+    // The bound tree is no taller than the syntax tree, so depth (its stored
+    // height) bounds the recursion, even through a corrupt entry.
+    static std::shared_ptr<BoundNode> read_node(std::istream &in, unsigned int line_count, size_t depth)
+    {
+        if (depth == 0)
+        {
+            return nullptr;
+        }
+        int tag, type;
+        unsigned int col;
+        if (!(in >> tag >> type >> col) || in.get() != ' ')
+        {
+            return nullptr;
+        }
+        auto node = read_node_body(in, line_count, depth, tag, type);
+        if (node)
+        {
+            node->line_ = line_count;
+            node->col_ = col;
+        }
+        return node;
+    }
+
+    // Whether a stored literal reads back the way the evaluator reads it
+    static bool valid_literal(BoundExpressionTag tag, const std::string &value)
+    {
+        if (tag == BoundExpressionTag::boolean)
+        {
+            return value == "true" || value == "false";
+        }
+        try
+        {
+            size_t end;
+            if (tag == BoundExpressionTag::integer)
+            {
+                std::stoi(value, &end);
+            }
+            else
+            {
+                std::stod(value, &end);
+            }
+            return end == value.size();
+        }
+        catch (const std::exception &)
+        {
+            return false;
+        }
+    }
+
+    // Anything out of range makes the entry a miss, rather than a bad tree
+    static std::shared_ptr<BoundNode> read_node_body(std::istream &in, unsigned int line_count, size_t depth, int tag,
+                                                     int type)
+    {
+        if (type < 0 || type > static_cast<int>(Type::floating))
+        {
+            return nullptr;
+        }
+        Type node_type = static_cast<Type>(type);
+        std::string value;
+        int op;
+        switch (static_cast<BoundExpressionTag>(tag))
+        {
+        case BoundExpressionTag::integer:
+            if (!read_string(in, value) || !valid_literal(BoundExpressionTag::integer, value))
+                return nullptr;
+            return std::make_shared<BoundIntegerExpression>(node_type, value);
+        case BoundExpressionTag::floating:
+            if (!read_string(in, value) || !valid_literal(BoundExpressionTag::floating, value))
+                return nullptr;
+            return std::make_shared<BoundFloatingExpression>(node_type, value);
+        case BoundExpressionTag::boolean:
+            if (!read_string(in, value) || !valid_literal(BoundExpressionTag::boolean, value))
+                return nullptr;
+            return std::make_shared<BoundBooleanExpression>(node_type, value);
+        case BoundExpressionTag::unary:
+        {
+            if (!(in >> op) || op < 0 || op > static_cast<int>(BoundUnaryOperatorTag::negation))
+                return nullptr;
+            auto expr = read_node(in, line_count, depth - 1);
+            if (!expr)
+                return nullptr;
+            return std::make_shared<BoundUnaryExpression>(node_type, static_cast<BoundUnaryOperatorTag>(op), expr);
+        }
+        case BoundExpressionTag::binary:
+        {
+            if (!(in >> op) || op < 0 || op > static_cast<int>(BoundBinaryOperatorTag::less_than))
+                return nullptr;
+            auto left = read_node(in, line_count, depth - 1);
+            auto right = left ? read_node(in, line_count, depth - 1) : nullptr;
+            if (!right)
+                return nullptr;
+            return std::make_shared<BoundBinaryExpression>(node_type, left, static_cast<BoundBinaryOperatorTag>(op), right);
+        }
+        default:
+            return nullptr;
+        }
+    }
+
+    std::filesystem::path dir_;
+    std::uintmax_t max_bytes_;
+    std::uintmax_t bytes_; // Estimated size of the cache directory
+    unsigned int tmp_count_;
+};
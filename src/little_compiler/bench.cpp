@@ -0,0 +1,325 @@
+#include "lexer.hpp"
+#include "generated_lexer.hpp"
+#include "parser.hpp"
+#include "binder.hpp"
+#include "evaluator.hpp"
+#include "fused_evaluator.hpp"
+#include "benchmark.hpp"
+
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Microbenchmarks of every compilation phase, on synthetic lines.
+// Inputs are built in code, so results only depend on the build.
+
+namespace
+{
+    // Lexer inputs
+
+    std::string identifier_line()
+    {
+        std::string line;
+        for (int i = 0; i < 64; i++)
+        {
+            line += "identifier" + std::to_string(i) + " ";
+        }
+        return line;
+    }
+
+    std::string number_line()
+    {
+        std::string line;
+        for (int i = 0; i < 64; i++)
+        {
+            line += std::to_string(i * 7919) + " + " + std::to_string(i) + ".25 * .5 - ";
+        }
+        return line + "1";
+    }
+
+    // Comments are only skipped right before a token, so each one is glued to
+    // the token that follows it
+    std::string comment_line()
+    {
+        std::string line;
+        for (int i = 0; i < 64; i++)
+        {
+            line += "/* some comment about " + std::to_string(i) + " */" + std::to_string(i) + " + ";
+        }
+        return line + "1 // and a trailing comment";
+    }
+
+    // Parser inputs
+
+    // 1 + 2 + 3 + ... , a left-leaning chain
+    std::string flat_expression()
+    {
+        std::string line = "1";
+        for (int i = 2; i <= 128; i++)
+        {
+            line += " + " + std::to_string(i);
+        }
+        return line;
+    }
+
+    // (1 + (2 + (3 + ...))), nested as deep as the count
+    std::string deep_expression()
+    {
+        const int depth = 128;
+        std::string line;
+        for (int i = 1; i < depth; i++)
+        {
+            line += "(" + std::to_string(i) + " + ";
+        }
+        line += std::to_string(depth);
+        line += std::string(depth - 1, ')');
+        return line;
+    }
+
+    // Many small, independent subtrees at every precedence level
+    std::string wide_expression()
+    {
+        std::string line;
+        for (int i = 0; i < 32; i++)
+        {
+            if (i != 0)
+            {
+                line += " && ";
+            }
+            // && binds tighter than < here, so comparisons need parentheses
+            line += "((" + std::to_string(i) + " * 2 + -1) < (" + std::to_string(i) + " * 3))";
+        }
+        return line;
+    }
+
+    bool same_tokens(const std::vector<Token> &a, const std::vector<Token> &b)
+    {
+        return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](const Token &x, const Token &y)
+                          { return x.tag_ == y.tag_ && x.val_ == y.val_ && x.line_count_ == y.line_count_ &&
+                                   x.char_count_ == y.char_count_; });
+    }
+
+    // Also checks both lexers give the same tokens
+    std::vector<Token> tokenize(const std::string &line)
+    {
+        HandwrittenLexer lexer;
+        auto tokens = lexer.tokenize_line(std::string(line));
+        if (!lexer.get_diagnostics().empty())
+        {
+            throw "Benchmark input doesn't tokenize";
+        }
+        GeneratedLexer generated;
+        if (!same_tokens(tokens, generated.tokenize_line(std::string(line))))
+        {
+            throw "Lexers disagree on benchmark input";
+        }
+        return tokens;
+    }
+
+    std::shared_ptr<SyntaxNode> parse(const std::string &line)
+    {
+        Parser parser;
+        auto tree = parser.parse(tokenize(line));
+        if (!parser.get_diagnostics().empty())
+        {
+            throw "Benchmark input doesn't parse";
+        }
+        return tree;
+    }
+
+    std::shared_ptr<BoundNode> bind(const std::string &line)
+    {
+        Binder binder;
+        auto ast = binder.bind(parse(line));
+        if (!binder.get_diagnostics().empty())
+        {
+            throw "Benchmark input doesn't bind";
+        }
+        return ast;
+    }
+
+    // Lexer state is kept between iterations, like in the driver
+    template <typename L>
+    Benchmark lexer_benchmark(const std::string &prefix, const std::string &name, const std::string &line)
+    {
+        auto lexer = std::make_shared<L>();
+        Benchmark b;
+        b.name_ = prefix + name;
+        b.items_ = tokenize(line).size();
+        b.run_ = [lexer, line](size_t)
+        {
+            auto tokens = lexer->tokenize_line(std::string(line));
+            do_not_optimize(tokens);
+        };
+        return b;
+    }
+
+    // Parser::parse consumes its tokens, so a copy per iteration is made
+    // before each sample
+    Benchmark parser_benchmark(const std::string &name, const std::string &line)
+    {
+        auto parser = std::make_shared<Parser>();
+        auto tokens = std::make_shared<std::vector<Token>>(tokenize(line));
+        auto inputs = std::make_shared<std::vector<std::vector<Token>>>();
+        Benchmark b;
+        b.name_ = "parser/" + name;
+        b.items_ = parse(line)->size_;
+        b.setup_ = [tokens, inputs](size_t iterations)
+        {
+            inputs->assign(iterations, *tokens);
+        };
+        b.run_ = [parser, inputs](size_t i)
+        {
+            auto tree = parser->parse(std::move((*inputs)[i]));
+            do_not_optimize(tree);
+        };
+        return b;
+    }
+
+    Benchmark binder_benchmark(const std::string &name, const std::string &line)
+    {
+        auto binder = std::make_shared<Binder>();
+        auto tree = parse(line);
+        Benchmark b;
+        b.name_ = "binder/" + name;
+        b.items_ = tree->size_;
+        b.run_ = [binder, tree](size_t)
+        {
+            auto ast = binder->bind(tree);
+            do_not_optimize(ast);
+        };
+        return b;
+    }
+
+    Benchmark evaluator_benchmark(const std::string &name, const std::string &line)
+    {
+        auto ast = bind(line);
+        Benchmark b;
+        b.name_ = "evaluator/" + name;
+        b.items_ = ast->size_;
+        b.run_ = [ast](size_t)
+        {
+            double result = Evaluator().evaluate_expression(*ast);
+            do_not_optimize(result);
+        };
+        return b;
+    }
+
+    // Parse, bind and evaluate in one pass, to compare with the sum of the
+    // three phases above
+    Benchmark fused_benchmark(const std::string &name, const std::string &line)
+    {
+        auto fused = std::make_shared<FusedEvaluator>();
+        auto tokens = std::make_shared<std::vector<Token>>(tokenize(line));
+        Benchmark b;
+        b.name_ = "fused/" + name;
+        b.items_ = parse(line)->size_;
+        b.run_ = [fused, tokens](size_t)
+        {
+            double result;
+            if (fused->evaluate(*tokens, result) != FusedEvaluator::Status::ok)
+            {
+                throw "Benchmark input doesn't evaluate";
+            }
+            do_not_optimize(result);
+        };
+        return b;
+    }
+
+    std::vector<Benchmark> all_benchmarks()
+    {
+        std::vector<Benchmark> benchmarks;
+        const std::pair<std::string, std::string> lines[] = {
+            {"identifiers", identifier_line()},
+            {"numbers", number_line()},
+            {"comments", comment_line()},
+        };
+        for (const auto &line : lines)
+            benchmarks.push_back(lexer_benchmark<HandwrittenLexer>("lexer/", line.first, line.second));
+        for (const auto &line : lines)
+            benchmarks.push_back(lexer_benchmark<GeneratedLexer>("generated_lexer/", line.first, line.second));
+
+        const std::pair<std::string, std::string> shapes[] = {
+            {"flat", flat_expression()},
+            {"deep", deep_expression()},
+            {"wide", wide_expression()},
+        };
+        for (const auto &shape : shapes)
+            benchmarks.push_back(parser_benchmark(shape.first, shape.second));
+        for (const auto &shape : shapes)
+            benchmarks.push_back(binder_benchmark(shape.first, shape.second));
+        for (const auto &shape : shapes)
+            benchmarks.push_back(evaluator_benchmark(shape.first, shape.second));
+        for (const auto &shape : shapes)
+            benchmarks.push_back(fused_benchmark(shape.first, shape.second));
+        return benchmarks;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    BenchmarkOptions options;
+    std::string filter;
+    bool json = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--filter=", 0) == 0)
+        {
+            filter = arg.substr(std::string("--filter=").size());
+        }
+        else if (arg.rfind("--samples=", 0) == 0)
+        {
+            options.samples_ = std::stoul(arg.substr(std::string("--samples=").size()));
+        }
+        else if (arg.rfind("--warmup=", 0) == 0)
+        {
+            options.warmup_ = std::stoul(arg.substr(std::string("--warmup=").size()));
+        }
+        else if (arg.rfind("--min-sample-ms=", 0) == 0)
+        {
+            options.min_sample_ns_ = std::stoull(arg.substr(std::string("--min-sample-ms=").size())) * 1000000;
+        }
+        else if (arg == "--perf-counters")
+        {
+            options.perf_counters_ = true;
+        }
+        else if (arg == "--format=json")
+        {
+            json = true;
+        }
+        else if (arg == "--format=text")
+        {
+            json = false;
+        }
+        else
+        {
+            std::cout << "Usage: " << argv[0] << " [--filter=<substring>] [--samples=N] [--warmup=N]"
+                      << " [--min-sample-ms=N] [--perf-counters] [--format=text|json]" << std::endl;
+            return -1;
+        }
+    }
+    if (options.samples_ == 0)
+    {
+        std::cout << "--samples must be at least 1" << std::endl;
+        return -1;
+    }
+
+    std::vector<BenchmarkResult> results;
+    for (const auto &benchmark : all_benchmarks())
+    {
+        if (benchmark.name_.find(filter) != std::string::npos)
+        {
+            results.push_back(run_benchmark(benchmark, options));
+        }
+    }
+
+    if (json)
+        write_benchmark_json(std::cout, results);
+    else
+        write_benchmark_text(std::cout, results);
+    return 0;
+}
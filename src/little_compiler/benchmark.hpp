@@ -0,0 +1,229 @@
+#pragma once
+
+// Minimal, self-contained microbenchmark harness.
+//
+// Each benchmark is calibrated first: the number of iterations per sample is
+// doubled until a sample takes at least min_sample_ns. After a few untimed
+// warm-up samples, the timed samples are summarized as nanoseconds per
+// iteration (median and percentiles). Optionally, perf counters are read
+// around the timed samples too (see perf_counters.hpp).
+
+#include "perf_counters.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Keeps the compiler from optimizing away a computed value
+template <typename T>
+inline void do_not_optimize(const T &value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else
+    static const void *volatile sink;
+    sink = &value;
+#endif
+}
+
+struct Benchmark
+{
+    std::string name_;
+    // Called before every sample, untimed, with the number of iterations the
+    // sample will run (ie to prepare inputs that iterations consume)
+    std::function<void(size_t iterations)> setup_;
+    // One timed iteration; i is its index within the sample
+    std::function<void(size_t i)> run_;
+    uint64_t items_ = 0; // Units of work per iteration (tokens, nodes, ...), for throughput
+};
+
+struct BenchmarkOptions
+{
+    size_t warmup_ = 3;
+    size_t samples_ = 30;
+    uint64_t min_sample_ns_ = 2000000;
+    bool perf_counters_ = false;
+};
+
+struct BenchmarkResult
+{
+    std::string name_;
+    size_t iterations_ = 0; // Per sample
+    uint64_t items_ = 0;
+    std::vector<double> ns_per_iteration_; // One per sample, sorted
+    PerfSample perf_;                      // Over all timed samples, with perf counters
+    uint64_t perf_iterations_ = 0;
+
+    double percentile(double p) const
+    {
+        if (ns_per_iteration_.empty())
+            return 0;
+        size_t rank = static_cast<size_t>(p / 100 * (ns_per_iteration_.size() - 1) + 0.5);
+        return ns_per_iteration_[rank];
+    }
+
+    double median() const { return percentile(50); }
+    double min() const { return ns_per_iteration_.empty() ? 0 : ns_per_iteration_.front(); }
+    double max() const { return ns_per_iteration_.empty() ? 0 : ns_per_iteration_.back(); }
+};
+
+inline BenchmarkResult run_benchmark(const Benchmark &benchmark, const BenchmarkOptions &options)
+{
+    // Counters are read outside of the timed span, as reading them takes syscalls
+    auto sample = [&benchmark](size_t iterations, PerfSample *perf = nullptr)
+    {
+        if (benchmark.setup_)
+        {
+            benchmark.setup_(iterations);
+        }
+        PerfSample perf_start;
+        if (perf)
+        {
+            perf_start = thread_perf_counters().read();
+        }
+        auto start = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < iterations; i++)
+        {
+            benchmark.run_(i);
+        }
+        auto end = std::chrono::steady_clock::now();
+        if (perf)
+        {
+            *perf += thread_perf_counters().read() - perf_start;
+        }
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    };
+
+    BenchmarkResult result;
+    result.name_ = benchmark.name_;
+    result.items_ = benchmark.items_;
+
+    // Calibrate
+    size_t iterations = 1;
+    while (sample(iterations) < options.min_sample_ns_ && iterations < (size_t(1) << 30))
+    {
+        iterations *= 2;
+    }
+    result.iterations_ = iterations;
+
+    for (size_t i = 0; i < options.warmup_; i++)
+    {
+        sample(iterations);
+    }
+
+    for (size_t i = 0; i < options.samples_; i++)
+    {
+        result.ns_per_iteration_.push_back(
+            static_cast<double>(sample(iterations, options.perf_counters_ ? &result.perf_ : nullptr)) / iterations);
+    }
+    if (options.perf_counters_)
+    {
+        result.perf_iterations_ = iterations * options.samples_;
+    }
+    std::sort(result.ns_per_iteration_.begin(), result.ns_per_iteration_.end());
+    return result;
+}
+
+// One line per benchmark, in fixed-width columns
+inline void write_benchmark_text(std::ostream &out, const std::vector<BenchmarkResult> &results)
+{
+    out << std::left << std::setw(32) << "benchmark" << std::right
+        << std::setw(12) << "iterations"
+        << std::setw(14) << "median ns"
+        << std::setw(14) << "p10 ns"
+        << std::setw(14) << "p90 ns"
+        << std::setw(14) << "p99 ns"
+        << std::setw(14) << "min ns"
+        << std::setw(14) << "max ns"
+        << std::setw(16) << "items/s" << "\n";
+    out << std::fixed << std::setprecision(1);
+    for (const auto &r : results)
+    {
+        double median = r.median();
+        out << std::left << std::setw(32) << r.name_ << std::right
+            << std::setw(12) << r.iterations_
+            << std::setw(14) << median
+            << std::setw(14) << r.percentile(10)
+            << std::setw(14) << r.percentile(90)
+            << std::setw(14) << r.percentile(99)
+            << std::setw(14) << r.min()
+            << std::setw(14) << r.max()
+            << std::setw(16) << (median > 0 ? r.items_ * 1e9 / median : 0) << "\n";
+    }
+
+    // Then counters per iteration, for the events that are available
+    const PerfCounters &counters = thread_perf_counters();
+    bool any_perf = std::any_of(results.begin(), results.end(), [](const BenchmarkResult &r)
+                                { return r.perf_iterations_ > 0; });
+    if (any_perf)
+    {
+        out << "\n"
+            << std::left << std::setw(32) << ("perf counters (" + std::string(PerfCounters::source_name(counters.source())) + ")")
+            << std::right;
+        for (int i = 0; i < static_cast<int>(PerfEvent::count); i++)
+        {
+            if (counters.available(static_cast<PerfEvent>(i)))
+                out << std::setw(16) << perf_event_name(static_cast<PerfEvent>(i));
+        }
+        if (counters.available(PerfEvent::cycles) && counters.available(PerfEvent::instructions))
+            out << std::setw(8) << "ipc";
+        out << "\n";
+        out << std::setprecision(2);
+        for (const auto &r : results)
+        {
+            if (r.perf_iterations_ == 0)
+                continue;
+            out << std::left << std::setw(32) << r.name_ << std::right;
+            for (int i = 0; i < static_cast<int>(PerfEvent::count); i++)
+            {
+                if (counters.available(static_cast<PerfEvent>(i)))
+                    out << std::setw(16) << static_cast<double>(r.perf_.values_[i]) / r.perf_iterations_;
+            }
+            if (counters.available(PerfEvent::cycles) && counters.available(PerfEvent::instructions))
+            {
+                uint64_t cycles = r.perf_[PerfEvent::cycles];
+                out << std::setw(8) << (cycles ? static_cast<double>(r.perf_[PerfEvent::instructions]) / cycles : 0);
+            }
+            out << "\n";
+        }
+    }
+    out << std::defaultfloat;
+}
+
+inline void write_benchmark_json(std::ostream &out, const std::vector<BenchmarkResult> &results)
+{
+    out << "{\n  \"benchmarks\": [\n";
+    out << std::fixed << std::setprecision(1);
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const auto &r = results[i];
+        double median = r.median();
+        out << "    {\"name\": \"" << r.name_ << "\""
+            << ", \"iterations\": " << r.iterations_
+            << ", \"samples\": " << r.ns_per_iteration_.size()
+            << ", \"items\": " << r.items_
+            << ", \"median_ns\": " << median
+            << ", \"p10_ns\": " << r.percentile(10)
+            << ", \"p90_ns\": " << r.percentile(90)
+            << ", \"p99_ns\": " << r.percentile(99)
+            << ", \"min_ns\": " << r.min()
+            << ", \"max_ns\": " << r.max()
+            << ", \"items_per_s\": " << (median > 0 ? r.items_ * 1e9 / median : 0);
+        if (r.perf_iterations_ > 0)
+        {
+            // Totals over perf_iterations
+            out << ", \"perf_source\": \"" << PerfCounters::source_name(thread_perf_counters().source()) << "\""
+                << ", \"perf_iterations\": " << r.perf_iterations_ << ", \"perf\": {";
+            thread_perf_counters().write_json_fields(out, r.perf_);
+            out << "}";
+        }
+        out << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << std::defaultfloat;
+    out << "  ]\n}\n";
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "parser.hpp"
+#include "work_stealing_pool.hpp"
 
 #include <string>
 #include <vector>
@@ -28,7 +29,7 @@ enum class Type
 };
 
 // Print support for types
-std::ostream &operator<<(std::ostream &os, Type type)
+inline std::ostream &operator<<(std::ostream &os, Type type)
 {
 #define TOKEN_TAG_CASE(tag) \
     case Type::tag:         \
@@ -58,9 +59,8 @@ enum class BoundBinaryOperatorTag
     division,
     equal,
     not_equal,
-        and,
-    or
-    ,
+    logical_and,
+    logical_or,
     greater_than,
     less_than
 };
@@ -99,9 +99,13 @@ enum class BoundBinaryOperatorTag
 
 struct BoundNode
 {
-    BoundNode(BoundExpressionTag tag, Type type) : tag_(tag), type_(type) {}
+    BoundNode(BoundExpressionTag tag, Type type, size_t size = 1) : tag_(tag), type_(type), size_(size) {}
     BoundExpressionTag tag_;
     Type type_;
+    size_t size_; // Number of nodes in this subtree
+    // Position of the node's token (the operator, for binary expressions)
+    unsigned int line_ = 0;
+    unsigned int col_ = 0;
 };
 
 struct BoundIntegerExpression : public BoundNode
@@ -134,7 +138,7 @@ struct BoundBooleanExpression : public BoundNode
 struct BoundUnaryExpression : public BoundNode
 {
     BoundUnaryExpression(Type type, BoundUnaryOperatorTag operation, std::shared_ptr<BoundNode> expr)
-        : BoundNode(BoundExpressionTag::unary, type), tag_(operation), expr_(expr)
+        : BoundNode(BoundExpressionTag::unary, type, 1 + expr->size_), tag_(operation), expr_(expr)
     {
     }
 
@@ -144,7 +148,7 @@ struct BoundUnaryExpression : public BoundNode
 struct BoundBinaryExpression : public BoundNode
 {
     BoundBinaryExpression(Type type, std::shared_ptr<BoundNode> left, BoundBinaryOperatorTag operation, std::shared_ptr<BoundNode> right)
-        : BoundNode(BoundExpressionTag::binary, type), left_(left), tag_(operation), right_(right)
+        : BoundNode(BoundExpressionTag::binary, type, 1 + left->size_ + right->size_), tag_(operation), left_(left), right_(right)
     {
     }
     BoundBinaryOperatorTag tag_;
@@ -155,6 +159,11 @@ struct BoundBinaryExpression : public BoundNode
 class Binder
 {
 public:
+    // With a pool, the operands of binary expressions are bound concurrently,
+    // once both of them have at least fork_threshold nodes
+    Binder(WorkStealingPool *pool = nullptr, size_t fork_threshold = default_fork_threshold)
+        : pool_(pool), fork_threshold_(fork_threshold) {}
+
     // Binder()
     // {
     //     // Add supported types
@@ -183,26 +192,46 @@ public:
 private:
     std::shared_ptr<BoundNode> bind_expression(std::shared_ptr<SyntaxNode> root)
     {
+        if (budget_)
+        {
+            budget_->tick(Phase::binding);
+        }
         SyntaxTag tag = root->tag_;
 
+        std::shared_ptr<BoundNode> node;
         switch (tag)
         {
         case SyntaxTag::integer_expression:
-            return bind_integer(root);
+            node = bind_integer(root);
+            break;
         case SyntaxTag::floating_expression:
-            return bind_floating(root);
+            node = bind_floating(root);
+            break;
         case SyntaxTag::boolean_expression:
-            return bind_boolean(root);
+            node = bind_boolean(root);
+            break;
         case SyntaxTag::unary_expression:
-            return bind_unary(root);
+            node = bind_unary(root);
+            break;
         case SyntaxTag::binary_expression:
-            return bind_binary(root);
+            node = bind_binary(root);
+            break;
         case SyntaxTag::parenthesized_expression:
+            // No node of its own, the inner expression keeps its position
             return bind_parenthesis(root);
         default:
-            std::cout << "Unreachable" << std::endl;
-            throw "Unreachable";
+        {
+            // Filled in as an int, like the parser does with unknown tokens
+            std::stringstream err;
+            err << "Error: Can't bind expression at (" << root->tok_.line_count_ << ", " << root->tok_.char_count_ << ")";
+            diagnostics_.push_back(err.str());
+            node = std::make_shared<BoundIntegerExpression>(Type::integer, "0");
+            break;
         }
+        }
+        node->line_ = root->tok_.line_count_;
+        node->col_ = root->tok_.char_count_;
+        return node;
     }
 
     std::shared_ptr<BoundNode> bind_integer(std::shared_ptr<SyntaxNode> node)
@@ -231,20 +260,30 @@ private:
         assert(node->tag_ == SyntaxTag::unary_expression);
         auto p = std::static_pointer_cast<UnaryExpression>(node);
         auto expr = bind_expression(p->expr_);
-        BoundUnaryOperatorTag op;
+        // Only reaches the tree with err_flag set, which stops it being evaluated
+        BoundUnaryOperatorTag op = BoundUnaryOperatorTag::identity;
+        bool err_flag = false;
         if (expr->type_ == Type::floating || expr->type_ == Type::integer)
         {
             if (p->tok_.tag_ == TokenTag::plus)
                 op = BoundUnaryOperatorTag::identity;
             else if (p->tok_.tag_ == TokenTag::minus)
                 op = BoundUnaryOperatorTag::negation;
+            else
+                err_flag = true;
         }
         else if (expr->type_ == Type::boolean)
         {
             if (p->tok_.tag_ == TokenTag::bang)
                 op = BoundUnaryOperatorTag::negation;
+            else
+                err_flag = true;
         }
         else
+        {
+            err_flag = true;
+        }
+        if (err_flag)
         {
             std::stringstream err;
             err << "Error: Can't use unary operator " << p->tok_ << " on type '" << expr->type_ << "'";
@@ -258,10 +297,28 @@ private:
         assert(node->tag_ == SyntaxTag::binary_expression);
         auto p = std::static_pointer_cast<BinaryExpression>(node);
 
-        auto left = bind_expression(p->left_);
-        auto right = bind_expression(p->right_);
+        std::shared_ptr<BoundNode> left;
+        std::shared_ptr<BoundNode> right;
+        if (pool_ && p->left_->size_ >= fork_threshold_ && p->right_->size_ >= fork_threshold_)
+        {
+            // The right side gets its own binder, whose diagnostics come after
+            // the left side's, like when binding in sequence
+            Binder right_binder(pool_, fork_threshold_);
+            right_binder.budget_ = budget_;
+            pool_->join([&]()
+                        { left = bind_expression(p->left_); },
+                        [&]()
+                        { right = right_binder.bind_expression(p->right_); });
+            diagnostics_.insert(diagnostics_.end(), right_binder.diagnostics_.begin(), right_binder.diagnostics_.end());
+        }
+        else
+        {
+            left = bind_expression(p->left_);
+            right = bind_expression(p->right_);
+        }
 
-        BoundBinaryOperatorTag tag;
+        // Only reaches the tree with err_flag set, which stops it being evaluated
+        BoundBinaryOperatorTag tag = BoundBinaryOperatorTag::addition;
         bool err_flag = false;
         Type return_type = left->type_;
         if (left->type_ == right->type_)
@@ -316,9 +373,9 @@ private:
                 else if (p->tok_.tag_ == TokenTag::not_equal)
                     tag = BoundBinaryOperatorTag::not_equal;
                 else if (p->tok_.tag_ == TokenTag::double_ampersand)
-                    tag = BoundBinaryOperatorTag::and;
+                    tag = BoundBinaryOperatorTag::logical_and;
                 else if (p->tok_.tag_ == TokenTag::double_vertical)
-                    tag = BoundBinaryOperatorTag:: or ;
+                    tag = BoundBinaryOperatorTag::logical_or;
                 else
                 {
                     err_flag = true;
@@ -356,8 +413,18 @@ public:
         return diagnostics_;
     }
 
+    // Limits the time of every bind from now on (nullptr for none). Depth and
+    // size are already limited by the parser.
+    void set_budget(const BudgetMeter *budget)
+    {
+        budget_ = budget;
+    }
+
 private:
     std::vector<std::string> diagnostics_;
+    const BudgetMeter *budget_ = nullptr;
+    WorkStealingPool *pool_;
+    size_t fork_threshold_;
 
     // OperatorTypeSupport operator_type_support;
 };
\ No newline at end of file
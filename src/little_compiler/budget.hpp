@@ -0,0 +1,176 @@
+#pragma once
+
+// Limits on the work spent on a single line, so that a pathological input
+// (huge, deeply nested, ...) can't monopolize a thread.
+//
+// Lexer, Parser, Binder and Evaluator check their limits through a
+// BudgetMeter as they go, and throw BudgetExceeded on a breach. Drivers catch
+// it and report the line as failed, with a "Budget error:" diagnostic, then
+// carry on with the next line.
+
+#include "phase.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+// Zero means unlimited
+struct Budget
+{
+    size_t max_tokens_ = 0;
+    size_t max_depth_ = 0; // Nesting of the syntax tree
+    size_t max_nodes_ = 0; // Of the syntax tree
+    size_t max_steps_ = 0; // Nodes visited by the evaluator
+    std::chrono::microseconds deadline_{0}; // Wall-clock time spent on the line, all phases included
+
+    bool limited() const
+    {
+        return max_tokens_ || max_depth_ || max_nodes_ || max_steps_ || deadline_.count();
+    }
+};
+
+// Parses a budget flag (ie --max-depth=100). Returns false if arg isn't one.
+inline bool parse_budget_flag(const std::string &arg, Budget &budget)
+{
+    auto value = [&arg]()
+    {
+        return std::stoull(arg.substr(arg.find('=') + 1));
+    };
+    if (arg.rfind("--max-tokens=", 0) == 0)
+        budget.max_tokens_ = value();
+    else if (arg.rfind("--max-depth=", 0) == 0)
+        budget.max_depth_ = value();
+    else if (arg.rfind("--max-nodes=", 0) == 0)
+        budget.max_nodes_ = value();
+    else if (arg.rfind("--max-steps=", 0) == 0)
+        budget.max_steps_ = value();
+    else if (arg.rfind("--deadline-us=", 0) == 0)
+        budget.deadline_ = std::chrono::microseconds(value());
+    else
+        return false;
+    return true;
+}
+
+// Limit that was breached, with a diagnostic in the usual format as what()
+class BudgetExceeded : public std::runtime_error
+{
+public:
+    enum class Limit
+    {
+        tokens,
+        depth,
+        nodes,
+        steps,
+        deadline
+    };
+
+    BudgetExceeded(Limit limit, uint64_t value, const std::string &msg)
+        : std::runtime_error(msg), limit_(limit), value_(value) {}
+
+    Limit limit_;
+    uint64_t value_; // The limit that was set
+};
+
+// Checks the budget of the line being processed
+class BudgetMeter
+{
+public:
+    explicit BudgetMeter(const Budget &budget = Budget()) : budget_(budget) {}
+
+    const Budget &budget() const
+    {
+        return budget_;
+    }
+
+    // Starts the clock for a new line, which may already have spent some time
+    // elsewhere (ie in earlier stages of a pipeline)
+    void start(std::chrono::nanoseconds spent = std::chrono::nanoseconds(0))
+    {
+        if (budget_.deadline_.count())
+        {
+            start_ = std::chrono::steady_clock::now() - spent;
+        }
+    }
+
+    std::chrono::nanoseconds elapsed() const
+    {
+        if (!budget_.deadline_.count())
+        {
+            return std::chrono::nanoseconds(0);
+        }
+        return std::chrono::steady_clock::now() - start_;
+    }
+
+    // To be called once per unit of work (token, node...). Only looks at the
+    // clock every so often.
+    void tick(Phase phase) const
+    {
+        if (budget_.deadline_.count() && (++ticks_ & 1023) == 0)
+        {
+            check_deadline(phase);
+        }
+    }
+
+    void check_deadline(Phase phase) const
+    {
+        if (budget_.deadline_.count() && elapsed() > budget_.deadline_)
+        {
+            std::stringstream err;
+            err << "Error: Budget exceeded: deadline of " << budget_.deadline_.count() << "us passed while "
+                << phase_name(phase);
+            throw BudgetExceeded(BudgetExceeded::Limit::deadline, budget_.deadline_.count(), err.str());
+        }
+    }
+
+    void check_tokens(size_t tokens, unsigned int line, unsigned int col) const
+    {
+        if (budget_.max_tokens_ && tokens > budget_.max_tokens_)
+        {
+            exceeded(BudgetExceeded::Limit::tokens, budget_.max_tokens_, "tokens", line, col);
+        }
+    }
+
+    void check_depth(size_t depth, unsigned int line, unsigned int col) const
+    {
+        if (budget_.max_depth_ && depth > budget_.max_depth_)
+        {
+            exceeded(BudgetExceeded::Limit::depth, budget_.max_depth_, "levels of nesting", line, col);
+        }
+    }
+
+    void check_nodes(size_t nodes, unsigned int line, unsigned int col) const
+    {
+        if (budget_.max_nodes_ && nodes > budget_.max_nodes_)
+        {
+            exceeded(BudgetExceeded::Limit::nodes, budget_.max_nodes_, "syntax nodes", line, col);
+        }
+    }
+
+    // Evaluation visits every node once, so its cost is known up front
+    void check_steps(size_t steps) const
+    {
+        if (budget_.max_steps_ && steps > budget_.max_steps_)
+        {
+            std::stringstream err;
+            err << "Error: Budget exceeded: evaluation takes " << steps << " steps, more than " << budget_.max_steps_;
+            throw BudgetExceeded(BudgetExceeded::Limit::steps, budget_.max_steps_, err.str());
+        }
+    }
+
+private:
+    [[noreturn]] static void exceeded(BudgetExceeded::Limit limit, uint64_t value, const char *what,
+                                      unsigned int line, unsigned int col)
+    {
+        std::stringstream err;
+        err << "Error: Budget exceeded: more than " << value << " " << what << " at (" << line << ", " << col << ")";
+        throw BudgetExceeded(limit, value, err.str());
+    }
+
+    Budget budget_;
+    std::chrono::steady_clock::time_point start_;
+
+    // Per thread, so that meters can be shared by parallel binding/evaluation
+    static inline thread_local unsigned int ticks_ = 0;
+};
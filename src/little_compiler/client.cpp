@@ -0,0 +1,124 @@
+/*
+Local client for little_server.
+
+Sends the lines of a file (or stdin) to the server in batched requests,
+without waiting for responses in between, and prints the results in the same
+format as `main --verbosity=diagnostics`.
+
+Usage: little_client <socket path> [input file|-] [--batch=N]
+ */
+
+#include "protocol.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// Prints one response line (see protocol.hpp)
+void print_response_line(std::string_view line, std::ostream &out)
+{
+    size_t tab = line.find('\t');
+    std::string_view status = line.substr(0, tab);
+    std::string_view rest = tab == std::string_view::npos ? std::string_view() : line.substr(tab + 1);
+
+    if (status == "ok")
+    {
+        out << "Evaluated: " << rest << "\n";
+    }
+    else if (status == "error")
+    {
+        // Header and diagnostics, one per line
+        while (!rest.empty())
+        {
+            tab = rest.find('\t');
+            out << rest.substr(0, tab) << "\n";
+            rest = tab == std::string_view::npos ? std::string_view() : rest.substr(tab + 1);
+        }
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    std::string socket_path;
+    std::string input_file = "-";
+    size_t batch = 256;
+
+    int positional = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--batch=", 0) == 0)
+            batch = std::max(1ul, std::stoul(arg.substr(8)));
+        else if (positional++ == 0)
+            socket_path = arg;
+        else
+            input_file = arg;
+    }
+
+    if (socket_path.empty())
+    {
+        std::cout << "Usage: " << argv[0] << " <socket path> [input file|-] [--batch=N]" << std::endl;
+        return -1;
+    }
+
+    std::ifstream file;
+    if (input_file != "-")
+    {
+        file.open(input_file);
+        if (!file)
+        {
+            std::cout << "Can't open " << input_file << std::endl;
+            return -1;
+        }
+    }
+    std::istream &in = input_file == "-" ? std::cin : file;
+
+    int fd = protocol::connect_to(socket_path);
+    if (fd < 0)
+    {
+        std::cout << "Can't connect to " << socket_path << ": " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+
+    // Requests are sent from their own thread, so they are pipelined with the
+    // responses we read below. Closing our end tells the server we're done.
+    std::thread sender([&in, fd, batch]()
+                       {
+        std::string payload, line;
+        size_t count = 0;
+        while (std::getline(in, line))
+        {
+            payload += line;
+            payload += '\n';
+            if (++count == batch)
+            {
+                if (!protocol::write_frame(fd, payload))
+                    break;
+                payload.clear();
+                count = 0;
+            }
+        }
+        if (count > 0)
+            protocol::write_frame(fd, payload);
+        ::shutdown(fd, SHUT_WR); });
+
+    std::ios::sync_with_stdio(false);
+    std::string response;
+    while (protocol::read_frame(fd, response))
+    {
+        std::string_view rest = response;
+        while (!rest.empty())
+        {
+            size_t end = rest.find('\n');
+            print_response_line(rest.substr(0, end), std::cout);
+            rest = end == std::string_view::npos ? std::string_view() : rest.substr(end + 1);
+        }
+    }
+
+    sender.join();
+    ::close(fd);
+    std::cout.flush();
+    return 0;
+}
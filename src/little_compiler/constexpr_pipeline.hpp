@@ -0,0 +1,561 @@
+#pragma once
+
+// A constexpr version of the Lexer -> Parser -> Binder -> Evaluator pipeline,
+// so that expressions known at build time can be evaluated by the C++ compiler:
+//
+//     constexpr double v = little::eval("2 * (-53 + 4)"); // -98
+//
+// It follows the runtime pipeline step by step, but uses fixed-capacity
+// containers instead of heap allocations. Instead of collecting diagnostics,
+// the first error throws; during constant evaluation this turns malformed input
+// into a compile error pointing at the message below.
+
+#include "binder.hpp"
+
+#include <array>
+#include <climits>
+#include <cstddef>
+#include <string_view>
+
+namespace little
+{
+    // Fixed-capacity vector, usable in constant expressions
+    template <typename T, size_t N>
+    class StaticVector
+    {
+    public:
+        constexpr void push_back(const T &value)
+        {
+            if (size_ == N)
+            {
+                throw "Error: expression exceeds the capacity of the constexpr pipeline";
+            }
+            data_[size_++] = value;
+        }
+
+        constexpr T &operator[](size_t i) { return data_[i]; }
+        constexpr const T &operator[](size_t i) const { return data_[i]; }
+        constexpr size_t size() const { return size_; }
+        constexpr T &back() { return data_[size_ - 1]; }
+
+    private:
+        std::array<T, N> data_{};
+        size_t size_ = 0;
+    };
+
+    struct StaticToken
+    {
+        TokenTag tag_ = TokenTag::bad;
+        std::string_view val_;
+    };
+
+    // Syntax node, with the binder's results filled in place
+    struct StaticNode
+    {
+        SyntaxTag tag_ = SyntaxTag::integer_expression;
+        size_t tok_ = 0;   // Index of the node's token
+        size_t left_ = 0;  // Operand of unary/parenthesized expressions, left of binary ones
+        size_t right_ = 0; // Right operand of binary expressions
+
+        Type type_ = Type::integer;
+        BoundUnaryOperatorTag unary_op_ = BoundUnaryOperatorTag::identity;
+        BoundBinaryOperatorTag binary_op_ = BoundBinaryOperatorTag::addition;
+    };
+
+    constexpr bool is_digit(char c) { return c >= '0' && c <= '9'; }
+    constexpr bool is_alpha(char c) { return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z'); }
+    constexpr bool is_alnum(char c) { return is_alpha(c) || is_digit(c); }
+
+    template <size_t MaxTokens, size_t MaxNodes>
+    class StaticPipeline
+    {
+    public:
+        constexpr StaticPipeline(std::string_view input) : input_(input) {}
+
+        constexpr double eval()
+        {
+            tokenize();
+            size_t root = parse_expression(0);
+            match(TokenTag::eof);
+            bind(root);
+            return evaluate(root);
+        }
+
+    private:
+        // Lexer (see HandwrittenLexer::next_token)
+
+        // Past the end of the input, behave like a null terminated string
+        constexpr char at(size_t i) const
+        {
+            return i < input_.size() ? input_[i] : '\0';
+        }
+
+        constexpr void push_token(TokenTag tag, size_t begin)
+        {
+            tokens_.push_back({tag, input_.substr(begin, p_ - begin)});
+        }
+
+        constexpr void tokenize()
+        {
+            do
+            {
+                next_token();
+            } while (tokens_.back().tag_ != TokenTag::eof);
+        }
+
+        constexpr void next_token()
+        {
+            // Step 1: Ignore spaces/tabs/newlines
+            while (at(p_) == ' ' || at(p_) == '\t' || at(p_) == '\n')
+            {
+                p_++;
+            }
+
+            // Step 2: Ignore comments
+            if (at(p_) == '/' && at(p_ + 1) == '/')
+            {
+                while (at(p_) != '\n' && at(p_) != '\0')
+                {
+                    p_++;
+                }
+            }
+            else if (at(p_) == '/' && at(p_ + 1) == '*')
+            {
+                p_ += 2;
+                while (at(p_) != '*')
+                {
+                    if (at(p_) == '\0')
+                    {
+                        throw "Error: invalid syntax: expected \"/*\" to close with \"*/\"";
+                    }
+                    p_++;
+                }
+                if (at(++p_) != '/')
+                {
+                    throw "Error: invalid syntax: expected \"/*\" to close with \"*/\"";
+                }
+                p_++;
+            }
+
+            size_t begin = p_;
+            char c = at(p_);
+            if (c == '\0')
+            {
+                push_token(TokenTag::eof, begin);
+                return;
+            }
+
+            // Step 3: Actual parsing of a token
+            if (c == '.' && is_digit(at(p_ + 1)))
+            {
+                do
+                {
+                    p_++;
+                } while (is_digit(at(p_)));
+                push_token(TokenTag::val_double, begin);
+                return;
+            }
+            if (is_digit(c))
+            {
+                bool is_float = false;
+                do
+                {
+                    p_++;
+                    if (at(p_) == '.' && !is_float)
+                    {
+                        is_float = true;
+                        p_++;
+                    }
+                } while (is_digit(at(p_)));
+                push_token(is_float ? TokenTag::val_double : TokenTag::val_int, begin);
+                return;
+            }
+            if (is_alpha(c))
+            {
+                do
+                {
+                    p_++;
+                } while (is_alnum(at(p_)));
+                push_token(TokenTag::id, begin);
+                return;
+            }
+
+            TokenTag tag = TokenTag::bad;
+            char n = at(p_ + 1);
+            if (c == '&' && n == '&')
+                tag = TokenTag::double_ampersand;
+            else if (c == '=' && n == '=')
+                tag = TokenTag::equal;
+            else if (c == '!' && n == '=')
+                tag = TokenTag::not_equal;
+            if (tag != TokenTag::bad)
+            {
+                p_ += 2;
+                push_token(tag, begin);
+                return;
+            }
+
+            switch (c)
+            {
+            case '+':
+                tag = TokenTag::plus;
+                break;
+            case '-':
+                tag = TokenTag::minus;
+                break;
+            case '*':
+                tag = TokenTag::star;
+                break;
+            case '/':
+                tag = TokenTag::slash;
+                break;
+            case '(':
+                tag = TokenTag::parenthesis_open;
+                break;
+            case ')':
+                tag = TokenTag::parenthesis_close;
+                break;
+            case '!':
+                tag = TokenTag::bang;
+                break;
+            case '>':
+                tag = TokenTag::greater_than;
+                break;
+            case '<':
+                tag = TokenTag::less_than;
+                break;
+            default:
+                throw "Error: Invalid token";
+            }
+            p_++;
+            push_token(tag, begin);
+        }
+
+        // Parser (see Parser::parse_expression)
+
+        constexpr const StaticToken &current() const
+        {
+            return tokens_[t_];
+        }
+
+        constexpr size_t next()
+        {
+            size_t curr = t_;
+            if (t_ < tokens_.size() - 1)
+            {
+                t_++;
+            }
+            return curr;
+        }
+
+        constexpr size_t match(TokenTag tag)
+        {
+            if (current().tag_ != tag)
+            {
+                throw "Error: Unexpected token";
+            }
+            return next();
+        }
+
+        constexpr size_t push_node(SyntaxTag tag, size_t tok, size_t left = 0, size_t right = 0)
+        {
+            StaticNode node;
+            node.tag_ = tag;
+            node.tok_ = tok;
+            node.left_ = left;
+            node.right_ = right;
+            nodes_.push_back(node);
+            return nodes_.size() - 1;
+        }
+
+        constexpr size_t parse_primary_expression()
+        {
+            if (current().tag_ == TokenTag::parenthesis_open)
+            {
+                size_t open = match(TokenTag::parenthesis_open);
+                size_t expr = parse_expression(0);
+                match(TokenTag::parenthesis_close);
+                return push_node(SyntaxTag::parenthesized_expression, open, expr);
+            }
+
+            size_t tok = t_;
+            switch (current().tag_)
+            {
+            case TokenTag::val_double:
+                next();
+                return push_node(SyntaxTag::floating_expression, tok);
+            case TokenTag::val_int:
+                next();
+                return push_node(SyntaxTag::integer_expression, tok);
+            case TokenTag::id:
+                if (current().val_ == "true" || current().val_ == "false")
+                {
+                    next();
+                    return push_node(SyntaxTag::boolean_expression, tok);
+                }
+                throw "Unreachable";
+            default:
+                throw "Error: Unexpected token, expected primary type";
+            }
+        }
+
+        constexpr size_t parse_expression(int order)
+        {
+            size_t left = 0;
+
+            // Handle unary operators
+            int precedence = unary_operator_precedence(current().tag_);
+            if (precedence != 0 && precedence >= order)
+            {
+                size_t op = next();
+                size_t expr = parse_expression(precedence);
+                left = push_node(SyntaxTag::unary_expression, op, expr);
+            }
+            else
+            {
+                left = parse_primary_expression();
+            }
+
+            while (true)
+            {
+                // Handle binary operators
+                int precedence = binary_operator_precedence(current().tag_);
+                if (precedence == 0 || precedence <= order)
+                    break;
+                size_t op = next();
+                size_t right = parse_expression(precedence);
+                left = push_node(SyntaxTag::binary_expression, op, left, right);
+            }
+            return left;
+        }
+
+        // Binder (see Binder::bind_expression)
+
+        constexpr void bind(size_t i)
+        {
+            StaticNode &node = nodes_[i];
+            TokenTag op = tokens_[node.tok_].tag_;
+            switch (node.tag_)
+            {
+            case SyntaxTag::integer_expression:
+                node.type_ = Type::integer;
+                return;
+            case SyntaxTag::floating_expression:
+                node.type_ = Type::floating;
+                return;
+            case SyntaxTag::boolean_expression:
+                node.type_ = Type::boolean;
+                return;
+            case SyntaxTag::parenthesized_expression:
+                bind(node.left_);
+                node.type_ = nodes_[node.left_].type_;
+                return;
+            case SyntaxTag::unary_expression:
+            {
+                bind(node.left_);
+                node.type_ = nodes_[node.left_].type_;
+                if (node.type_ != Type::boolean && op == TokenTag::plus)
+                    node.unary_op_ = BoundUnaryOperatorTag::identity;
+                else if (node.type_ != Type::boolean && op == TokenTag::minus)
+                    node.unary_op_ = BoundUnaryOperatorTag::negation;
+                else if (node.type_ == Type::boolean && op == TokenTag::bang)
+                    node.unary_op_ = BoundUnaryOperatorTag::negation;
+                else
+                    throw "Error: Can't use unary operator on this type";
+                return;
+            }
+            case SyntaxTag::binary_expression:
+            {
+                bind(node.left_);
+                bind(node.right_);
+                Type left = nodes_[node.left_].type_;
+                Type right = nodes_[node.right_].type_;
+                if (left != right)
+                {
+                    throw "Error: Can't use operator on different types";
+                }
+
+                node.type_ = left;
+                if (left == Type::integer || left == Type::floating)
+                {
+                    switch (op)
+                    {
+                    case TokenTag::plus:
+                        node.binary_op_ = BoundBinaryOperatorTag::addition;
+                        return;
+                    case TokenTag::minus:
+                        node.binary_op_ = BoundBinaryOperatorTag::subtraction;
+                        return;
+                    case TokenTag::star:
+                        node.binary_op_ = BoundBinaryOperatorTag::multiplication;
+                        return;
+                    case TokenTag::slash:
+                        node.binary_op_ = BoundBinaryOperatorTag::division;
+                        return;
+                    default:
+                        break;
+                    }
+                    node.type_ = Type::boolean;
+                    switch (op)
+                    {
+                    case TokenTag::greater_than:
+                        node.binary_op_ = BoundBinaryOperatorTag::greater_than;
+                        return;
+                    case TokenTag::less_than:
+                        node.binary_op_ = BoundBinaryOperatorTag::less_than;
+                        return;
+                    case TokenTag::equal:
+                        node.binary_op_ = BoundBinaryOperatorTag::equal;
+                        return;
+                    case TokenTag::not_equal:
+                        node.binary_op_ = BoundBinaryOperatorTag::not_equal;
+                        return;
+                    default:
+                        break;
+                    }
+                }
+                else
+                {
+                    switch (op)
+                    {
+                    case TokenTag::equal:
+                        node.binary_op_ = BoundBinaryOperatorTag::equal;
+                        return;
+                    case TokenTag::not_equal:
+                        node.binary_op_ = BoundBinaryOperatorTag::not_equal;
+                        return;
+                    case TokenTag::double_ampersand:
+                        node.binary_op_ = BoundBinaryOperatorTag::logical_and;
+                        return;
+                    case TokenTag::double_vertical:
+                        node.binary_op_ = BoundBinaryOperatorTag::logical_or;
+                        return;
+                    default:
+                        break;
+                    }
+                }
+                throw "Error: Can't use operator on these types";
+            }
+            }
+        }
+
+        // Evaluator (see Evaluator::evaluate_expression)
+
+        // Same as std::stoi on a token made of digits
+        static constexpr double parse_int(std::string_view str)
+        {
+            long long value = 0;
+            for (char c : str)
+            {
+                value = value * 10 + (c - '0');
+                if (value > INT_MAX)
+                {
+                    throw "Error: integer literal out of range";
+                }
+            }
+            return static_cast<double>(value);
+        }
+
+        // Same as std::stod on a token of the form "123.456", ".5" or "12."
+        // The digits are gathered into an exact integer, and divided by an exact
+        // power of ten, so the single rounding step gives the correctly rounded
+        // result that std::stod returns.
+        static constexpr double parse_double(std::string_view str)
+        {
+            unsigned long long mantissa = 0;
+            int scale = 0;
+            bool fraction = false;
+            for (char c : str)
+            {
+                if (c == '.')
+                {
+                    fraction = true;
+                    continue;
+                }
+                if (mantissa >= (1ull << 53) / 10)
+                {
+                    // Further digits can't be represented exactly anymore
+                    throw "Error: floating literal too long for constant evaluation";
+                }
+                mantissa = mantissa * 10 + (c - '0');
+                scale += fraction ? 1 : 0;
+            }
+            if (scale > 22)
+            {
+                throw "Error: floating literal too long for constant evaluation";
+            }
+
+            double power = 1;
+            for (int i = 0; i < scale; i++)
+            {
+                power *= 10;
+            }
+            return static_cast<double>(mantissa) / power;
+        }
+
+        constexpr double evaluate(size_t i) const
+        {
+            const StaticNode &node = nodes_[i];
+            switch (node.tag_)
+            {
+            case SyntaxTag::integer_expression:
+                return parse_int(tokens_[node.tok_].val_);
+            case SyntaxTag::floating_expression:
+                return parse_double(tokens_[node.tok_].val_);
+            case SyntaxTag::boolean_expression:
+                return tokens_[node.tok_].val_ == "true";
+            case SyntaxTag::parenthesized_expression:
+                return evaluate(node.left_);
+            case SyntaxTag::unary_expression:
+                if (node.unary_op_ == BoundUnaryOperatorTag::identity)
+                    return evaluate(node.left_);
+                if (node.type_ == Type::boolean)
+                    return evaluate(node.left_) > 0 ? 0 : 1;
+                return -evaluate(node.left_);
+            case SyntaxTag::binary_expression:
+                break;
+            }
+
+            double left = evaluate(node.left_);
+            double right = evaluate(node.right_);
+            switch (node.binary_op_)
+            {
+            case BoundBinaryOperatorTag::addition:
+                return left + right;
+            case BoundBinaryOperatorTag::subtraction:
+                return left - right;
+            case BoundBinaryOperatorTag::multiplication:
+                return left * right;
+            case BoundBinaryOperatorTag::division:
+                return left / right;
+            case BoundBinaryOperatorTag::equal:
+                return left == right ? 1 : 0;
+            case BoundBinaryOperatorTag::not_equal:
+                return left != right ? 1 : 0;
+            case BoundBinaryOperatorTag::greater_than:
+                return left > right ? 1 : 0;
+            case BoundBinaryOperatorTag::less_than:
+                return left < right ? 1 : 0;
+            case BoundBinaryOperatorTag::logical_and:
+                return (left != 0 && right != 0) ? 1 : 0;
+            case BoundBinaryOperatorTag::logical_or:
+                return (left != 0 || right != 0) ? 1 : 0;
+            }
+            throw "Evaluator error: invalid binary op tag";
+        }
+
+        std::string_view input_;
+        size_t p_ = 0; // Pointer to current character in input_
+        size_t t_ = 0; // Pointer to current token in tokens_
+        StaticVector<StaticToken, MaxTokens> tokens_;
+        StaticVector<StaticNode, MaxNodes> nodes_;
+    };
+
+    // Evaluates a single line, the same way main does with the runtime pipeline.
+    // Longer expressions may raise the capacities, ie eval<1024, 1024>(...).
+    template <size_t MaxTokens = 128, size_t MaxNodes = 128>
+    constexpr double eval(std::string_view line)
+    {
+        return StaticPipeline<MaxTokens, MaxNodes>(line).eval();
+    }
+}
@@ -1,34 +1,117 @@
 #pragma once
 #include "parser.hpp"
 #include "binder.hpp"
+#include "evaluator_profiler.hpp"
 
+// Evaluates bound trees. Holds no state (besides an optional pool), and never
+// modifies the tree, so a single tree can be evaluated from several threads at
+// once.
 class Evaluator
 {
 public:
-    double evaluate_expression(std::shared_ptr<BoundNode> root)
+    // With a pool, the operands of binary expressions are evaluated
+    // concurrently, once both of them have at least fork_threshold nodes
+    Evaluator(WorkStealingPool *pool = nullptr, size_t fork_threshold = default_fork_threshold)
+        : pool_(pool), fork_threshold_(fork_threshold) {}
+
+    double evaluate_expression(std::shared_ptr<BoundNode> root) const
     {
-        if (root->tag_ == BoundExpressionTag::integer)
+        return evaluate_expression(*root);
+    }
+
+    double evaluate_expression(const BoundNode &root) const
+    {
+        if (budget_)
         {
-            auto r = std::static_pointer_cast<BoundIntegerExpression>(root);
-            return std::stoi(r->value_);
+            budget_->check_steps(root.size_);
         }
-        else if (root->tag_ == BoundExpressionTag::floating)
+        if (!profiler_)
         {
-            auto r = std::static_pointer_cast<BoundFloatingExpression>(root);
-            return std::stod(r->value_);
+            return evaluate_node<false>(root);
         }
-        else if (root->tag_ == BoundExpressionTag::boolean)
+        try
         {
-            auto r = std::static_pointer_cast<BoundBooleanExpression>(root);
-            return r->value_ == "true";
+            return evaluate_node<true>(root);
         }
-        else if (root->tag_ == BoundExpressionTag::binary)
+        catch (...)
         {
-            auto r = std::static_pointer_cast<BoundBinaryExpression>(root);
-            auto left = evaluate_expression(r->left_);
-            auto right = evaluate_expression(r->right_);
+            profiler_->abandon();
+            throw;
+        }
+    }
+
+    // Limits steps and time of every evaluation from now on (nullptr for none)
+    void set_budget(const BudgetMeter *budget)
+    {
+        budget_ = budget;
+    }
+
+    // Profiles every evaluation from now on (nullptr for none). Profiled
+    // evaluations stay on the calling thread, pool or not.
+    void set_profiler(EvaluatorProfiler *profiler)
+    {
+        profiler_ = profiler;
+    }
+
+private:
+    // Works on references rather than shared_ptrs, so that walking a shared tree
+    // doesn't touch (and contend on) its reference counts.
+    // Instantiated with and without profiling, so that unprofiled evaluations
+    // don't pay for it
+    template <bool Profiled>
+    double evaluate_node(const BoundNode &root) const
+    {
+        if (!Profiled)
+        {
+            return evaluate_node_body<false>(root);
+        }
+        profiler_->enter(root);
+        double result = evaluate_node_body<true>(root);
+        profiler_->leave();
+        return result;
+    }
 
-            switch (r->tag_)
+    template <bool Profiled>
+    double evaluate_node_body(const BoundNode &root) const
+    {
+        if (budget_)
+        {
+            budget_->tick(Phase::evaluating);
+        }
+        if (root.tag_ == BoundExpressionTag::integer)
+        {
+            auto &r = static_cast<const BoundIntegerExpression &>(root);
+            return std::stoi(r.value_);
+        }
+        else if (root.tag_ == BoundExpressionTag::floating)
+        {
+            auto &r = static_cast<const BoundFloatingExpression &>(root);
+            return std::stod(r.value_);
+        }
+        else if (root.tag_ == BoundExpressionTag::boolean)
+        {
+            auto &r = static_cast<const BoundBooleanExpression &>(root);
+            return r.value_ == "true";
+        }
+        else if (root.tag_ == BoundExpressionTag::binary)
+        {
+            auto &r = static_cast<const BoundBinaryExpression &>(root);
+            double left;
+            double right;
+            if (!Profiled && pool_ && r.left_->size_ >= fork_threshold_ && r.right_->size_ >= fork_threshold_)
+            {
+                pool_->join([&]()
+                            { left = evaluate_node<Profiled>(*r.left_); },
+                            [&]()
+                            { right = evaluate_node<Profiled>(*r.right_); });
+            }
+            else
+            {
+                left = evaluate_node<Profiled>(*r.left_);
+                right = evaluate_node<Profiled>(*r.right_);
+            }
+
+            switch (r.tag_)
             {
             case BoundBinaryOperatorTag::addition:
                 return left + right;
@@ -46,9 +129,9 @@ public:
                 return left > right ? 1 : 0;
             case BoundBinaryOperatorTag::less_than:
                 return left < right ? 1 : 0;
-            case BoundBinaryOperatorTag::and:
+            case BoundBinaryOperatorTag::logical_and:
                 return ((bool)left && (bool)right) ? 1 : 0;
-            case BoundBinaryOperatorTag:: or:
+            case BoundBinaryOperatorTag::logical_or:
                 return ((bool)left || (bool)right) ? 1 : 0;
             }
 
@@ -57,22 +140,22 @@ public:
             std::cout << "Evaluator error: invalid binary op tag" << std::endl;
             throw "Evaluator error: invalid binary op tag";
         }
-        else if (root->tag_ == BoundExpressionTag::unary)
+        else if (root.tag_ == BoundExpressionTag::unary)
         {
-            auto r = std::static_pointer_cast<BoundUnaryExpression>(root);
-            switch (r->tag_)
+            auto &r = static_cast<const BoundUnaryExpression &>(root);
+            switch (r.tag_)
             {
             case BoundUnaryOperatorTag::negation:
-                if (r->type_ == Type::boolean)
-                    return evaluate_expression(r->expr_) > 0 ? 0 : 1;
+                if (r.type_ == Type::boolean)
+                    return evaluate_node<Profiled>(*r.expr_) > 0 ? 0 : 1;
                 else
-                    return -evaluate_expression(r->expr_);
+                    return -evaluate_node<Profiled>(*r.expr_);
 
             case BoundUnaryOperatorTag::identity:
-                return evaluate_expression(r->expr_);
+                return evaluate_node<Profiled>(*r.expr_);
             }
             // unreachable
-            std::cout << "Evaluator error: invalid unary op tag " << (int)r->tag_ << std::endl;
+            std::cout << "Evaluator error: invalid unary op tag " << (int)r.tag_ << std::endl;
             throw "Evaluator error: invalid unary op token tag";
         }
         else
@@ -82,4 +165,9 @@ public:
             throw "Evaluator error: invalid syntax node tag";
         }
     }
+
+    WorkStealingPool *pool_;
+    size_t fork_threshold_;
+    const BudgetMeter *budget_ = nullptr;
+    EvaluatorProfiler *profiler_ = nullptr;
 };
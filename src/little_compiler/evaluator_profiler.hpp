@@ -0,0 +1,237 @@
+#pragma once
+#include "binder.hpp"
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define LITTLE_PROFILE_RDTSC 1
+#elif defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#define LITTLE_PROFILE_RDTSC 1
+#else
+#define LITTLE_PROFILE_RDTSC 0
+#endif
+
+// Counts executions and time spent in each node the Evaluator visits.
+//
+// Nodes are grouped by call path (the chain of nodes from the root of the
+// expression), each identified by its operator and position in the source.
+// Time is exclusive (children not included), and measured with the time
+// stamp counter where there is one, or else a monotonic clock in ns.
+//
+// Profiles are written as folded stacks, one line per call path, ie
+//     line 3;addition (3, 5);multiplication (3, 9) 1234
+// which flame graph tools (flamegraph.pl, speedscope, inferno...) take as is.
+//
+// Not thread safe: a profiled Evaluator evaluates on the calling thread only.
+class EvaluatorProfiler
+{
+public:
+    static constexpr const char *tick_unit = LITTLE_PROFILE_RDTSC ? "cycles" : "ns";
+
+    static uint64_t now()
+    {
+#if LITTLE_PROFILE_RDTSC
+        return __rdtsc();
+#else
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                   std::chrono::steady_clock::now().time_since_epoch())
+            .count();
+#endif
+    }
+
+    EvaluatorProfiler()
+    {
+        frames_.push_back(Frame{}); // Root of all call paths
+        stack_.push_back(Active{0, 0, 0});
+    }
+
+    // Called by the Evaluator around each node
+    void enter(const BoundNode &node)
+    {
+        unsigned int kind = kind_of(node);
+        size_t parent = stack_.back().frame_;
+        uint64_t key = mix(parent, kind, node.line_, node.col_);
+        auto it = index_.find(key);
+        size_t frame;
+        if (it != index_.end() && same_frame(frames_[it->second], parent, kind, node))
+        {
+            frame = it->second;
+        }
+        else
+        {
+            frame = add_frame(key, parent, kind, node);
+        }
+        stack_.push_back(Active{frame, now(), 0});
+    }
+
+    void leave()
+    {
+        uint64_t end = now();
+        Active active = stack_.back();
+        stack_.pop_back();
+
+        uint64_t total = end - active.start_;
+        uint64_t self = total > active.children_ ? total - active.children_ : 0;
+        Frame &frame = frames_[active.frame_];
+        frame.count_++;
+        frame.self_ticks_ += self;
+        kinds_[frame.kind_].count_++;
+        kinds_[frame.kind_].self_ticks_ += self;
+        stack_.back().children_ += total;
+    }
+
+    // Drops the nodes still being timed, after an evaluation threw
+    void abandon()
+    {
+        stack_.resize(1);
+        stack_.back().children_ = 0;
+    }
+
+    // One line per call path, with its exclusive time
+    void write_folded(std::ostream &out) const
+    {
+        std::vector<size_t> path;
+        for (size_t i = 1; i < frames_.size(); i++)
+        {
+            if (frames_[i].count_ == 0)
+            {
+                continue;
+            }
+            path.clear();
+            for (size_t f = i; f != 0; f = frames_[f].parent_)
+            {
+                path.push_back(f);
+            }
+            out << "line " << frames_[path.back()].line_;
+            for (auto it = path.rbegin(); it != path.rend(); ++it)
+            {
+                const Frame &frame = frames_[*it];
+                out << ";" << kind_names[frame.kind_] << " (" << frame.line_ << ", " << frame.col_ << ")";
+            }
+            out << " " << frames_[i].self_ticks_ << "\n";
+        }
+    }
+
+    // Executions and exclusive time per operator (and literal type)
+    void write_summary(std::ostream &out) const
+    {
+        out << std::left << std::setw(16) << "operator" << std::right << std::setw(14) << "count"
+            << std::setw(18) << (std::string("self ") + tick_unit) << std::setw(14) << "avg" << "\n";
+        for (unsigned int kind = 0; kind < kind_count; kind++)
+        {
+            const KindStats &stats = kinds_[kind];
+            if (stats.count_ == 0)
+            {
+                continue;
+            }
+            out << std::left << std::setw(16) << kind_names[kind] << std::right << std::setw(14) << stats.count_
+                << std::setw(18) << stats.self_ticks_ << std::setw(14) << std::fixed << std::setprecision(1)
+                << double(stats.self_ticks_) / stats.count_ << "\n";
+        }
+        out << std::defaultfloat;
+    }
+
+private:
+    // Binary operator tags, then unary operator tags, then literal types
+    static constexpr unsigned int binary_kinds = 10;
+    static constexpr unsigned int unary_kinds = 2;
+    static constexpr unsigned int kind_count = binary_kinds + unary_kinds + 3;
+    static constexpr const char *kind_names[kind_count] = {
+        "addition", "subtraction", "multiplication", "division", "equal", "not_equal",
+        "logical_and", "logical_or", "greater_than", "less_than",
+        "identity", "negation",
+        "integer", "floating", "boolean"};
+
+    static unsigned int kind_of(const BoundNode &node)
+    {
+        switch (node.tag_)
+        {
+        case BoundExpressionTag::binary:
+            return static_cast<unsigned int>(static_cast<const BoundBinaryExpression &>(node).tag_) % binary_kinds;
+        case BoundExpressionTag::unary:
+            return binary_kinds + static_cast<unsigned int>(static_cast<const BoundUnaryExpression &>(node).tag_) % unary_kinds;
+        case BoundExpressionTag::integer:
+            return binary_kinds + unary_kinds;
+        case BoundExpressionTag::floating:
+            return binary_kinds + unary_kinds + 1;
+        default:
+            return binary_kinds + unary_kinds + 2;
+        }
+    }
+
+    struct Frame
+    {
+        size_t parent_ = 0;
+        unsigned int kind_ = 0;
+        unsigned int line_ = 0;
+        unsigned int col_ = 0;
+        uint64_t count_ = 0;
+        uint64_t self_ticks_ = 0;
+        size_t next_ = 0; // Next frame with the same key, 0 if none
+    };
+
+    struct Active
+    {
+        size_t frame_;
+        uint64_t start_;
+        uint64_t children_; // Total time of the children so far
+    };
+
+    struct KindStats
+    {
+        uint64_t count_ = 0;
+        uint64_t self_ticks_ = 0;
+    };
+
+    static uint64_t mix(uint64_t parent, uint64_t kind, uint64_t line, uint64_t col)
+    {
+        uint64_t h = parent * 0x9e3779b97f4a7c15ull;
+        h ^= (kind << 56) ^ (line << 24) ^ col;
+        h ^= h >> 31;
+        return h * 0xbf58476d1ce4e5b9ull;
+    }
+
+    static bool same_frame(const Frame &frame, size_t parent, unsigned int kind, const BoundNode &node)
+    {
+        return frame.parent_ == parent && frame.kind_ == kind && frame.line_ == node.line_ && frame.col_ == node.col_;
+    }
+
+    // Frames are chained by key, in case two call paths collide
+    size_t add_frame(uint64_t key, size_t parent, unsigned int kind, const BoundNode &node)
+    {
+        auto it = index_.find(key);
+        if (it != index_.end())
+        {
+            for (size_t f = it->second; f != 0; f = frames_[f].next_)
+            {
+                if (same_frame(frames_[f], parent, kind, node))
+                {
+                    return f;
+                }
+            }
+        }
+
+        Frame frame;
+        frame.parent_ = parent;
+        frame.kind_ = kind;
+        frame.line_ = node.line_;
+        frame.col_ = node.col_;
+        frame.next_ = it != index_.end() ? it->second : 0;
+        frames_.push_back(frame);
+        index_[key] = frames_.size() - 1;
+        return frames_.size() - 1;
+    }
+
+    std::vector<Frame> frames_; // Parents always come before their children
+    std::unordered_map<uint64_t, size_t> index_;
+    std::vector<Active> stack_;
+    KindStats kinds_[kind_count];
+};
@@ -0,0 +1,369 @@
+#pragma once
+#include "binder.hpp"
+#include "budget.hpp"
+#include "token.hpp"
+
+#include <algorithm>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Parses, type checks and evaluates a line in a single pass, without building
+// a syntax tree or a bound tree.
+//
+// Mirrors Parser::parse_expression (same precedence climbing, same budget
+// accounting), applying the rules of the Binder and the Evaluator as each
+// node is completed. Nodes complete in the order the Binder visits them, so
+// diagnostics come out the same as with Parser -> Binder -> Evaluator.
+//
+// Lines that don't go through the tree path cleanly (unknown identifiers,
+// literals out of range, unary operators on the wrong type) are
+// handed back to the caller with Status::fallback, to be compiled the usual
+// way.
+class FusedEvaluator
+{
+public:
+    enum class Status
+    {
+        ok,
+        parser_error, // get_diagnostics() holds the Parser's diagnostics
+        binder_error, // get_diagnostics() holds the Binder's diagnostics
+        fallback,     // Needs the tree path
+    };
+
+    // tokens must end with an eof token, as the lexer makes them
+    Status evaluate(const std::vector<Token> &tokens, double &result)
+    {
+        // Reset state
+        tokens_ = &tokens;
+        p_ = 0;
+        diagnostics_.clear();
+        binder_diagnostics_.clear();
+        depth_ = 0;
+        nodes_ = 0;
+        steps_ = 0;
+
+        Value value;
+        try
+        {
+            value = parse_expression();
+        }
+        catch (const Fallback &)
+        {
+            return Status::fallback;
+        }
+        match(TokenTag::eof);
+
+        // The Binder only runs on lines that parse
+        if (!diagnostics_.empty())
+        {
+            return Status::parser_error;
+        }
+        if (!binder_diagnostics_.empty())
+        {
+            diagnostics_.swap(binder_diagnostics_);
+            return Status::binder_error;
+        }
+        if (budget_)
+        {
+            budget_->check_steps(steps_);
+        }
+        if (!value.valid_)
+        {
+            return Status::fallback;
+        }
+        result = value.value_;
+        return Status::ok;
+    }
+
+    std::vector<std::string> &get_diagnostics()
+    {
+        return diagnostics_;
+    }
+
+    // Nodes of the syntax tree the Parser would have built
+    size_t get_node_count() const
+    {
+        return nodes_;
+    }
+
+    // Limits depth, nodes, steps and time of every line from now on (nullptr for none)
+    void set_budget(const BudgetMeter *budget)
+    {
+        budget_ = budget;
+    }
+
+private:
+    // Result of a subexpression, as its bound node would have it
+    struct Value
+    {
+        Type type_ = Type::integer;
+        double value_ = 0;
+        bool valid_ = true; // False if evaluating it needs the tree path
+        size_t height_ = 1; // Of its syntax tree, as the Parser checks it
+    };
+
+    // Thrown where the Parser itself would give up
+    struct Fallback
+    {
+    };
+
+    const Token &current() const
+    {
+        return (*tokens_)[p_];
+    }
+
+    const Token &next()
+    {
+        const Token &curr = (*tokens_)[p_];
+        if (p_ < tokens_->size() - 1)
+        {
+            p_++;
+        }
+        return curr;
+    }
+
+    bool match(TokenTag tag)
+    {
+        if (current().tag_ == tag)
+        {
+            next();
+            return true;
+        }
+        std::stringstream err;
+        err << "Error: Unexpected token (" << current() << ") at (" << current().line_count_ << ", "
+            << current().char_count_ << "), expected <" << tag << "> type";
+        diagnostics_.push_back(err.str());
+        return false;
+    }
+
+    Value parse_primary_expression()
+    {
+        if (current().tag_ == TokenTag::parenthesis_open)
+        {
+            next();
+            Value value = parse_expression(0);
+            match(TokenTag::parenthesis_close);
+            value.height_++;
+            check_height(value);
+            return value;
+        }
+
+        const Token &tok = current();
+        Value value;
+        steps_++;
+        if (tok.tag_ == TokenTag::val_double)
+        {
+            next();
+            value.type_ = Type::floating;
+            try
+            {
+                value.value_ = std::stod(tok.val_);
+            }
+            catch (const std::exception &)
+            {
+                value.valid_ = false;
+            }
+        }
+        else if (tok.tag_ == TokenTag::val_int)
+        {
+            next();
+            try
+            {
+                value.value_ = std::stoi(tok.val_);
+            }
+            catch (const std::exception &)
+            {
+                value.valid_ = false;
+            }
+        }
+        else if (tok.tag_ == TokenTag::id && (tok.val_ == "true" || tok.val_ == "false"))
+        {
+            next();
+            value.type_ = Type::boolean;
+            value.value_ = tok.val_ == "true";
+        }
+        else if (tok.tag_ == TokenTag::id)
+        {
+            throw Fallback();
+        }
+        else
+        {
+            // Filled in as an int, like the Parser does
+            std::stringstream err;
+            err << "Error: Unexpected token (" << current() << ") at (" << current().line_count_ << ", "
+                << current().char_count_ << "), expected primary type";
+            diagnostics_.push_back(err.str());
+            value.valid_ = false;
+        }
+        return value;
+    }
+
+    // Counts one more node, at the current depth
+    void check_budget()
+    {
+        nodes_++;
+        if (budget_)
+        {
+            budget_->check_nodes(nodes_, current().line_count_, current().char_count_);
+            budget_->check_depth(depth_, current().line_count_, current().char_count_);
+            budget_->tick(Phase::parsing);
+        }
+    }
+
+    // Same as Parser::checked
+    void check_height(const Value &value)
+    {
+        if (budget_)
+        {
+            budget_->check_depth(value.height_, current().line_count_, current().char_count_);
+        }
+    }
+
+    Value parse_expression(int order = 0)
+    {
+        depth_++;
+        check_budget();
+
+        Value left;
+
+        // Handle unary operators
+        int precedence = current().get_unary_operator_precedence();
+        if (precedence != 0 && precedence >= order)
+        {
+            TokenTag op = next().tag_;
+            left = parse_expression(precedence);
+            size_t height = left.height_ + 1;
+            apply_unary(op, left);
+            left.height_ = height;
+            check_height(left);
+        }
+        else
+        {
+            left = parse_primary_expression();
+        }
+
+        while (true)
+        {
+            // Handle binary operators
+            int precedence = current().get_binary_operator_precedence();
+            if (precedence == 0 || precedence <= order)
+                break;
+            check_budget();
+            const Token &op = next();
+            Value right = parse_expression(precedence);
+            size_t height = 1 + std::max(left.height_, right.height_);
+            apply_binary(op, left, right);
+            left.height_ = height;
+            check_height(left);
+        }
+        depth_--;
+        return left;
+    }
+
+    void apply_unary(TokenTag op, Value &value)
+    {
+        steps_++;
+        if (value.type_ == Type::boolean && op == TokenTag::bang)
+        {
+            value.value_ = value.value_ > 0 ? 0 : 1;
+        }
+        else if (value.type_ != Type::boolean && op == TokenTag::plus)
+        {
+        }
+        else if (value.type_ != Type::boolean && op == TokenTag::minus)
+        {
+            value.value_ = -value.value_;
+        }
+        else
+        {
+            // The Binder rejects these, the tree path reports why
+            value.valid_ = false;
+        }
+    }
+
+    // Leaves the result in left
+    void apply_binary(const Token &op, Value &left, const Value &right)
+    {
+        steps_++;
+        left.valid_ = left.valid_ && right.valid_;
+        bool err_flag = false;
+        if (left.type_ != right.type_)
+        {
+            err_flag = true;
+        }
+        else if (left.type_ == Type::integer || left.type_ == Type::floating)
+        {
+            switch (op.tag_)
+            {
+            case TokenTag::plus:
+                left.value_ = left.value_ + right.value_;
+                break;
+            case TokenTag::minus:
+                left.value_ = left.value_ - right.value_;
+                break;
+            case TokenTag::star:
+                left.value_ = left.value_ * right.value_;
+                break;
+            case TokenTag::slash:
+                left.value_ = left.value_ / right.value_;
+                break;
+            case TokenTag::greater_than:
+                left.value_ = left.value_ > right.value_ ? 1 : 0;
+                left.type_ = Type::boolean;
+                break;
+            case TokenTag::less_than:
+                left.value_ = left.value_ < right.value_ ? 1 : 0;
+                left.type_ = Type::boolean;
+                break;
+            case TokenTag::equal:
+                left.value_ = left.value_ == right.value_ ? 1 : 0;
+                left.type_ = Type::boolean;
+                break;
+            case TokenTag::not_equal:
+                left.value_ = left.value_ != right.value_ ? 1 : 0;
+                left.type_ = Type::boolean;
+                break;
+            default:
+                err_flag = true;
+            }
+        }
+        else
+        {
+            switch (op.tag_)
+            {
+            case TokenTag::equal:
+                left.value_ = left.value_ == right.value_ ? 1 : 0;
+                break;
+            case TokenTag::not_equal:
+                left.value_ = left.value_ != right.value_ ? 1 : 0;
+                break;
+            case TokenTag::double_ampersand:
+                left.value_ = ((bool)left.value_ && (bool)right.value_) ? 1 : 0;
+                break;
+            case TokenTag::double_vertical:
+                left.value_ = ((bool)left.value_ || (bool)right.value_) ? 1 : 0;
+                break;
+            default:
+                err_flag = true;
+            }
+        }
+
+        // Same message as the Binder; the type stays the left one's
+        if (err_flag)
+        {
+            std::stringstream err;
+            err << "Error: Can't use operator " << op << " on types '" << left.type_ << "' and '" << right.type_ << "'";
+            binder_diagnostics_.push_back(err.str());
+        }
+    }
+
+    const std::vector<Token> *tokens_ = nullptr;
+    size_t p_ = 0;
+    std::vector<std::string> diagnostics_;
+    std::vector<std::string> binder_diagnostics_; // Held back until parsing succeeds
+    const BudgetMeter *budget_ = nullptr;
+    size_t depth_ = 0;
+    size_t nodes_ = 0;
+    size_t steps_ = 0; // Nodes of the bound tree, ie what the Evaluator would visit
+};
@@ -0,0 +1,176 @@
+#pragma once
+
+#include "token.hpp"
+#include "budget.hpp"
+#include "scanner_tables.hpp" // Generated from tokens.spec by scanner_generator
+
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Lexer running the DFA generated from tokens.spec: same tokens, positions
+// and diagnostics as HandwrittenLexer, and the same interface.
+//
+// Every step is a longest match of the one table-driven DFA, from the start
+// state of a section of the spec: trivia (as long as it matches), then one
+// comment, then the token. Adding a token is adding a rule to the spec.
+class GeneratedLexer
+{
+public:
+    GeneratedLexer() : input_(""), p_(0), line_(0) {}
+
+private:
+    using Tables = ScannerTables;
+
+    // Rule of the longest match from p_, starting at state, or -1 if none.
+    // Sets end to one past the match.
+    int longest_match(int state, unsigned int &end) const
+    {
+        const unsigned char *input = reinterpret_cast<const unsigned char *>(input_);
+        int rule = -1;
+        // '\0' leads to the dead state, so this stops at the end of the line
+        for (unsigned int i = p_;; i++)
+        {
+            state = Tables::next[state * Tables::classes + Tables::byte_class[input[i]]];
+            if (state == Tables::dead)
+            {
+                return rule;
+            }
+            if (Tables::accept[state] >= 0)
+            {
+                rule = Tables::accept[state];
+                end = i + 1;
+            }
+        }
+    }
+
+    Token next_token()
+    {
+        unsigned int end;
+        for (int rule; (rule = longest_match(Tables::start_trivia, end)) >= 0; p_ = end)
+        {
+            if (Tables::rules[rule].action_ == Tables::Action::newline)
+            {
+                line_++;
+            }
+        }
+
+        int rule = longest_match(Tables::start_comment, end);
+        if (rule >= 0)
+        {
+            p_ = end;
+            if (Tables::rules[rule].action_ == Tables::Action::unclosed_comment)
+            {
+                std::stringstream err;
+                err << "Error: invalid syntax: expected \"/*\" to close with \"*/\") at (" << line_ << ", " << p_ << ")";
+                diagnostics_.push_back(err.str());
+            }
+        }
+
+        if (input_[p_] == '\0')
+        {
+            return Token(TokenTag::eof, line_, p_);
+        }
+
+        rule = longest_match(Tables::start_token, end);
+        if (rule < 0)
+        {
+            std::string val(1, input_[p_]);
+
+            std::stringstream err;
+            err << "Error: Invalid token (" << val << ") at (" << line_ << ", " << p_ << ")";
+            diagnostics_.push_back(err.str());
+
+            return Token(TokenTag::bad, val, line_, ++p_);
+        }
+
+        const Tables::Rule &token = Tables::rules[rule];
+        unsigned int begin = p_;
+        p_ = end;
+        return Token(token.tag_, std::string(input_ + begin, end - begin), line_, token.at_last_ ? end - 1 : end);
+    }
+
+    void check_budget(size_t tokens)
+    {
+        try
+        {
+            budget_->check_tokens(tokens, line_, p_);
+            budget_->tick(Phase::lexing);
+        }
+        catch (const BudgetExceeded &)
+        {
+            // The line still counts, so the next one gets the right number
+            line_++;
+            throw;
+        }
+    }
+
+public:
+    std::vector<Token> tokenize_line(std::string &&next_line)
+    {
+        input_str_ = std::move(next_line);
+        return tokenize_line(input_str_.c_str());
+    }
+
+    // Tokenizes a null-terminated line in place, without copying it. The line
+    // only needs to outlive the call.
+    std::vector<Token> tokenize_line(const char *next_line)
+    {
+        input_ = next_line;
+        p_ = 0;
+        diagnostics_.clear();
+
+        std::vector<Token> tokens;
+
+        Token tok;
+        do
+        {
+            tok = next_token();
+            tokens.push_back(tok);
+            if (budget_)
+            {
+                check_budget(tokens.size());
+            }
+        } while (tok.tag_ != TokenTag::bad && tok.tag_ != TokenTag::eof);
+
+        line_++;
+
+        return tokens;
+    }
+
+    // Limits tokens, and time, of every line from now on (nullptr for none)
+    void set_budget(const BudgetMeter *budget)
+    {
+        budget_ = budget;
+    }
+
+    // Advances the line count without tokenizing, for lines that were
+    // compiled elsewhere (ie loaded from a cache)
+    void skip_line()
+    {
+        line_++;
+    }
+
+    unsigned int get_line_count() const
+    {
+        return line_;
+    }
+
+    void set_line_count(unsigned int line)
+    {
+        line_ = line;
+    }
+
+    std::vector<std::string> &get_diagnostics()
+    {
+        return diagnostics_;
+    }
+
+private:
+    const char *input_;     // Line being tokenized
+    std::string input_str_; // Owns the line, when given as a string
+    unsigned int p_;        // Offset of the next byte in input_
+    unsigned int line_;
+    std::vector<std::string> diagnostics_;
+    const BudgetMeter *budget_ = nullptr;
+};
@@ -0,0 +1,164 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+// Histogram of latencies (in ns), in the style of HDR histograms.
+//
+// Buckets are log-linear: every power of two is split in 32 linear
+// sub-buckets, so any recorded value is known to within ~3%, from 1ns to
+// centuries, in a fixed 15KiB. Recording is a couple of shifts and one
+// increment, with no allocation.
+//
+// One thread records, any number may read concurrently (ie to report while a
+// run is still going): counters are atomics, but only ever loaded and stored.
+class LatencyHistogram
+{
+public:
+    void record(uint64_t ns)
+    {
+        increment(buckets_[index(ns)]);
+        increment(count_);
+        if (ns > max_.load(std::memory_order_relaxed))
+        {
+            max_.store(ns, std::memory_order_relaxed);
+        }
+    }
+
+    uint64_t count() const
+    {
+        return count_.load(std::memory_order_relaxed);
+    }
+
+    uint64_t max() const
+    {
+        return max_.load(std::memory_order_relaxed);
+    }
+
+    // Smallest value that percent% of the recorded values are at or below,
+    // rounded up to the top of its bucket (but never above max())
+    uint64_t percentile(double percent) const
+    {
+        uint64_t total = count();
+        if (total == 0)
+        {
+            return 0;
+        }
+        uint64_t rank = static_cast<uint64_t>(percent / 100 * total + 0.5);
+        rank = std::max<uint64_t>(1, std::min(rank, total));
+        uint64_t seen = 0;
+        for (size_t i = 0; i < bucket_count; i++)
+        {
+            seen += buckets_[i].load(std::memory_order_relaxed);
+            if (seen >= rank)
+            {
+                return std::min(highest_in_bucket(i), max());
+            }
+        }
+        return max();
+    }
+
+    // {"count": ..., "p50": ..., "p90": ..., "p99": ..., "p99.9": ..., "max": ...}
+    void write_json(std::ostream &out) const
+    {
+        out << "{\"count\": " << count()
+            << ", \"p50\": " << percentile(50)
+            << ", \"p90\": " << percentile(90)
+            << ", \"p99\": " << percentile(99)
+            << ", \"p99.9\": " << percentile(99.9)
+            << ", \"max\": " << max() << "}";
+    }
+
+private:
+    static constexpr unsigned int sub_bucket_bits = 5;
+    static constexpr uint64_t sub_buckets = uint64_t(1) << sub_bucket_bits;
+    // Values below sub_buckets get a bucket each, then 32 per power of two
+    static constexpr size_t bucket_count = (64 - sub_bucket_bits + 1) * sub_buckets;
+
+    static void increment(std::atomic<uint64_t> &counter)
+    {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    static unsigned int log2(uint64_t v)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return 63 - __builtin_clzll(v);
+#else
+        unsigned int n = 0;
+        while (v >>= 1)
+            n++;
+        return n;
+#endif
+    }
+
+    static size_t index(uint64_t v)
+    {
+        if (v < sub_buckets)
+        {
+            return v;
+        }
+        unsigned int exponent = log2(v);
+        unsigned int shift = exponent - sub_bucket_bits;
+        return (exponent - sub_bucket_bits + 1) * sub_buckets + ((v >> shift) - sub_buckets);
+    }
+
+    static uint64_t highest_in_bucket(size_t i)
+    {
+        if (i < sub_buckets)
+        {
+            return i;
+        }
+        unsigned int shift = i / sub_buckets - 1;
+        uint64_t lowest = (sub_buckets + i % sub_buckets) << shift;
+        return lowest + ((uint64_t(1) << shift) - 1);
+    }
+
+    std::atomic<uint64_t> buckets_[bucket_count] = {};
+    std::atomic<uint64_t> count_{0};
+    std::atomic<uint64_t> max_{0};
+};
+
+// The n slowest lines seen so far, with their latency
+class SlowestLines
+{
+public:
+    explicit SlowestLines(size_t n = 10) : n_(n) {}
+
+    void record(uint64_t line, uint64_t ns)
+    {
+        if (heap_.size() < n_)
+        {
+            heap_.emplace_back(ns, line);
+            std::push_heap(heap_.begin(), heap_.end(), std::greater<>());
+        }
+        else if (n_ > 0 && ns > heap_.front().first)
+        {
+            std::pop_heap(heap_.begin(), heap_.end(), std::greater<>());
+            heap_.back() = {ns, line};
+            std::push_heap(heap_.begin(), heap_.end(), std::greater<>());
+        }
+    }
+
+    // [{"line": ..., "ns": ...}, ...], slowest first
+    void write_json(std::ostream &out) const
+    {
+        auto sorted = heap_;
+        std::sort(sorted.begin(), sorted.end(), std::greater<>());
+        out << "[";
+        for (size_t i = 0; i < sorted.size(); i++)
+        {
+            out << (i ? ", " : "") << "{\"line\": " << sorted[i].second << ", \"ns\": " << sorted[i].first << "}";
+        }
+        out << "]";
+    }
+
+private:
+    size_t n_;
+    std::vector<std::pair<uint64_t, uint64_t>> heap_; // (ns, line), fastest on top
+};
@@ -1,17 +1,20 @@
 #pragma once
 
 #include "token.hpp"
+#include "budget.hpp"
 
 #include <sstream>
 #include <string>
 #include <vector>
 
 // Takes raw text as input and extracts token one at a time, from left to right.
-class Lexer
+// Lexer is this hand-written version, or GeneratedLexer (see tokens.spec),
+// depending on LITTLE_COMPILER_GENERATED_LEXER.
+class HandwrittenLexer
 {
 
 public:
-    Lexer() : line_(0), p_(0) {}
+    HandwrittenLexer() : input_(""), line_(0), p_(0) {}
 
 private:
     const char &next_input_char()
@@ -22,18 +25,18 @@ private:
             err << "Error: invalid syntax: expected end of text at (" << line_ << ", " << p_ << ")";
             diagnostics_.push_back(err.str());
         }
-        return input_str_[++p_];
+        return input_[++p_];
     }
     const char &peek_ahead()
     {
-        return input_str_[p_ + 1];
+        return input_[p_ + 1];
     }
 
     Token next_token()
     {
 
         // Step 1: Ignore spaces/tabs/newlines, exit if end of str
-        for (peek_ = input_str_[p_];; peek_ = next_input_char())
+        for (peek_ = input_[p_];; peek_ = next_input_char())
         {
             if (peek_ == ' ' || peek_ == '\t')
             {
@@ -69,8 +72,11 @@ private:
                 do
                 {
                     peek_ = next_input_char();
-                } while (peek_ != '*');
-                peek_ = next_input_char();
+                } while (peek_ != '*' && peek_ != '\0');
+                if (peek_ == '*')
+                {
+                    peek_ = next_input_char();
+                }
                 if (peek_ != '/')
                 {
                     std::stringstream err;
@@ -203,12 +209,35 @@ private:
         }
     }
 
+    void check_budget(size_t tokens)
+    {
+        try
+        {
+            budget_->check_tokens(tokens, line_, p_);
+            budget_->tick(Phase::lexing);
+        }
+        catch (const BudgetExceeded &)
+        {
+            // The line still counts, so the next one gets the right number
+            line_++;
+            throw;
+        }
+    }
+
 public:
     std::vector<Token> tokenize_line(std::string &&next_line)
     {
-        // Reset state
         input_str_ = std::move(next_line);
-        peek_ = input_str_[0];
+        return tokenize_line(input_str_.c_str());
+    }
+
+    // Tokenizes a null-terminated line in place, without copying it. The line
+    // only needs to outlive the call.
+    std::vector<Token> tokenize_line(const char *next_line)
+    {
+        // Reset state
+        input_ = next_line;
+        peek_ = input_[0];
         p_ = 0;
         diagnostics_.clear();
 
@@ -219,6 +248,10 @@ public:
         {
             tok = this->next_token();
             tokens.push_back(tok);
+            if (budget_)
+            {
+                check_budget(tokens.size());
+            }
         } while (tok.tag_ != TokenTag::bad && tok.tag_ != TokenTag::eof);
 
         line_++;
@@ -226,6 +259,29 @@ public:
         return std::move(tokens);
     }
 
+    // Limits tokens, and time, of every line from now on (nullptr for none)
+    void set_budget(const BudgetMeter *budget)
+    {
+        budget_ = budget;
+    }
+
+    // Advances the line count without tokenizing, for lines that were
+    // compiled elsewhere (ie loaded from a cache)
+    void skip_line()
+    {
+        line_++;
+    }
+
+    unsigned int get_line_count() const
+    {
+        return line_;
+    }
+
+    void set_line_count(unsigned int line)
+    {
+        line_ = line;
+    }
+
     std::vector<std::string> &get_diagnostics()
     {
         return diagnostics_;
@@ -233,8 +289,17 @@ public:
 
 private:
     char peek_;
-    std::string input_str_;
-    unsigned int p_; // Pointer to current element in input_str_
+    const char *input_;     // Line being tokenized
+    std::string input_str_; // Owns the line, when given as a string
+    unsigned int p_; // Pointer to current element in input_
     unsigned int line_;
     std::vector<std::string> diagnostics_;
+    const BudgetMeter *budget_ = nullptr;
 };
+
+#if LITTLE_COMPILER_GENERATED_LEXER
+#include "generated_lexer.hpp"
+using Lexer = GeneratedLexer;
+#else
+using Lexer = HandwrittenLexer;
+#endif
@@ -0,0 +1,285 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+// Reads lines from a file descriptor (a file, a pipe, stdin...), with the
+// actual reads done ahead of time on a background thread.
+//
+// The reader thread fills a fixed set of large buffers with read(), and hands
+// them over as they fill up; while the caller works through the lines of one
+// buffer, the next one is being read. Lines are handed out in place: their
+// newline is overwritten with '\0', so they can go straight to the lexer.
+// A line that spans two buffers is stitched into a separate string.
+//
+// Memory use is bounded by the buffers, plus the longest line that spans two
+// of them, whatever the size of the stream.
+class LineReader
+{
+public:
+    // Opens path for reading, or stdin if path is "-". Returns -1 on failure.
+    static int open_input(const std::string &path)
+    {
+        if (path == "-")
+        {
+            return 0;
+        }
+#ifdef _WIN32
+        return _open(path.c_str(), _O_RDONLY | _O_BINARY);
+#else
+        return ::open(path.c_str(), O_RDONLY);
+#endif
+    }
+
+    // Takes ownership of fd, unless it's stdin
+    explicit LineReader(int fd, size_t buffer_size = 1 << 20, size_t buffer_count = 2)
+        : fd_(fd), buffer_size_(buffer_size)
+    {
+        for (size_t i = 0; i < buffer_count; i++)
+        {
+            buffers_.emplace_back(buffer_size_);
+            free_.push_back(&buffers_.back());
+        }
+        thread_ = std::thread([this]()
+                              { read_loop(); });
+    }
+
+    // Waits for the reader thread, which may still be blocked in read() if
+    // the stream wasn't consumed to its end.
+    ~LineReader()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        free_cv_.notify_one();
+        thread_.join();
+        if (fd_ > 0)
+        {
+#ifdef _WIN32
+            _close(fd_);
+#else
+            ::close(fd_);
+#endif
+        }
+    }
+
+    // Gets the next line, without its newline. The line is followed by a
+    // '\0' (ie line.data()[line.size()] == '\0'), and stays valid until the
+    // next call. Returns false at the end of the stream.
+    bool next_line(std::string_view &line)
+    {
+        while (true)
+        {
+            if (!current_)
+            {
+                current_ = take_filled();
+                pos_ = 0;
+                if (!current_)
+                {
+                    // End of stream, with maybe a last line without newline
+                    if (stitching_)
+                    {
+                        stitching_ = false;
+                        line = stitch_;
+                        return true;
+                    }
+                    return false;
+                }
+            }
+
+            char *begin = current_->data_.get() + pos_;
+            char *end = current_->data_.get() + current_->size_;
+            char *newline = static_cast<char *>(std::memchr(begin, '\n', end - begin));
+            if (newline)
+            {
+                *newline = '\0';
+                pos_ = newline - current_->data_.get() + 1;
+                if (stitching_)
+                {
+                    stitching_ = false;
+                    stitch_.append(begin, newline - begin);
+                    line = stitch_;
+                    return true;
+                }
+                line = std::string_view(begin, newline - begin);
+                return true;
+            }
+
+            // The rest of the buffer starts a line that ends in a later one
+            if (begin != end)
+            {
+                if (!stitching_)
+                {
+                    stitch_.clear();
+                    stitching_ = true;
+                }
+                stitch_.append(begin, end - begin);
+            }
+            release(current_);
+            current_ = nullptr;
+        }
+    }
+
+    // Whether reading stopped because of an I/O error, rather than the end of
+    // the stream
+    bool failed() const
+    {
+        return failed_;
+    }
+
+private:
+    struct Buffer
+    {
+        struct AlignedDelete
+        {
+            void operator()(char *p) const
+            {
+                ::operator delete[](p, std::align_val_t(alignment));
+            }
+        };
+
+        static constexpr size_t alignment = 4096;
+
+        explicit Buffer(size_t size)
+            : data_(static_cast<char *>(::operator new[](size, std::align_val_t(alignment)))) {}
+
+        std::unique_ptr<char[], AlignedDelete> data_;
+        size_t size_ = 0;
+    };
+
+    void read_loop()
+    {
+        while (true)
+        {
+            Buffer *buffer;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                free_cv_.wait(lock, [this]()
+                              { return stop_ || !free_.empty(); });
+                if (stop_)
+                {
+                    break;
+                }
+                buffer = free_.front();
+                free_.pop_front();
+            }
+
+            // Fill the buffer, but hand it over early rather than keep a
+            // waiting consumer idle
+            bool done = false;
+            buffer->size_ = 0;
+            while (buffer->size_ < buffer_size_)
+            {
+#ifdef _WIN32
+                long n = _read(fd_, buffer->data_.get() + buffer->size_,
+                               static_cast<unsigned>(std::min<size_t>(buffer_size_ - buffer->size_, 1 << 30)));
+#else
+                ssize_t n = ::read(fd_, buffer->data_.get() + buffer->size_, buffer_size_ - buffer->size_);
+#endif
+                if (n < 0 && errno == EINTR)
+                {
+                    continue;
+                }
+                if (n <= 0)
+                {
+                    failed_ = n < 0;
+                    done = true;
+                    break;
+                }
+                buffer->size_ += n;
+                if (consumer_waiting_.load(std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (buffer->size_ > 0)
+                {
+                    filled_.push_back(buffer);
+                }
+                else
+                {
+                    free_.push_back(buffer);
+                }
+                done_ = done;
+            }
+            filled_cv_.notify_one();
+            if (done)
+            {
+                break;
+            }
+        }
+    }
+
+    // Next filled buffer, or nullptr at the end of the stream
+    Buffer *take_filled()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (filled_.empty() && !done_)
+        {
+            consumer_waiting_.store(true, std::memory_order_relaxed);
+            filled_cv_.wait(lock, [this]()
+                            { return done_ || !filled_.empty(); });
+            consumer_waiting_.store(false, std::memory_order_relaxed);
+        }
+        if (filled_.empty())
+        {
+            return nullptr;
+        }
+        Buffer *buffer = filled_.front();
+        filled_.pop_front();
+        return buffer;
+    }
+
+    void release(Buffer *buffer)
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            free_.push_back(buffer);
+        }
+        free_cv_.notify_one();
+    }
+
+    int fd_;
+    size_t buffer_size_;
+    std::deque<Buffer> buffers_; // Never moves its elements once in place
+
+    // Shared with the reader thread
+    std::mutex mutex_;
+    std::condition_variable free_cv_;
+    std::condition_variable filled_cv_;
+    std::deque<Buffer *> free_;
+    std::deque<Buffer *> filled_;
+    bool done_ = false;
+    bool stop_ = false;
+    bool failed_ = false; // Written before done_ is published
+    std::atomic<bool> consumer_waiting_{false};
+    std::thread thread_;
+
+    // Consumer side
+    Buffer *current_ = nullptr;
+    size_t pos_ = 0;
+    std::string stitch_;
+    bool stitching_ = false;
+};
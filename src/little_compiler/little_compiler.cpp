@@ -0,0 +1,79 @@
+#include "little_compiler.hpp"
+
+namespace little
+{
+    CompiledExpression::CompiledExpression(std::string source, std::shared_ptr<const BoundNode> ast,
+                                           std::string error_header, std::vector<std::string> diagnostics)
+        : source_(std::move(source)), ast_(std::move(ast)),
+          error_header_(std::move(error_header)), diagnostics_(std::move(diagnostics))
+    {
+    }
+
+    Context::Context() : meter_(std::make_unique<BudgetMeter>())
+    {
+    }
+
+    void Context::set_budget(const Budget &budget)
+    {
+        *meter_ = BudgetMeter(budget);
+        const BudgetMeter *meter = budget.limited() ? meter_.get() : nullptr;
+        lexer_.set_budget(meter);
+        parser_.set_budget(meter);
+        binder_.set_budget(meter);
+        evaluator_.set_budget(meter);
+    }
+
+    std::shared_ptr<const CompiledExpression> Context::compile(std::string source, unsigned int line_count)
+    {
+        auto failed = [&source](const char *header, const std::vector<std::string> &diagnostics)
+        {
+            return std::make_shared<const CompiledExpression>(std::move(source), nullptr, header, diagnostics);
+        };
+
+        try
+        {
+            meter_->start();
+            lexer_.set_line_count(line_count);
+            std::vector<Token> tokens = lexer_.tokenize_line(std::string(source));
+            if (!lexer_.get_diagnostics().empty())
+            {
+                return failed("Lexer error:", lexer_.get_diagnostics());
+            }
+
+            if (tokens.size() == 1 && tokens[0].tag_ == TokenTag::eof)
+            {
+                return failed("", {});
+            }
+
+            auto parse_tree = parser_.parse(std::move(tokens));
+            if (!parser_.get_diagnostics().empty())
+            {
+                return failed("Parser error:", parser_.get_diagnostics());
+            }
+
+            auto ast = binder_.bind(parse_tree);
+            if (!binder_.get_diagnostics().empty())
+            {
+                return failed("Parser error:", binder_.get_diagnostics());
+            }
+
+            return std::make_shared<const CompiledExpression>(std::move(source), std::move(ast), "", std::vector<std::string>());
+        }
+        catch (const BudgetExceeded &e)
+        {
+            return failed("Budget error:", {e.what()});
+        }
+    }
+
+    double Context::evaluate(const CompiledExpression &expr) const
+    {
+        meter_->start();
+        return evaluator_.evaluate_expression(*expr.ast());
+    }
+
+    std::shared_ptr<const CompiledExpression> compile(std::string source, unsigned int line_count)
+    {
+        Context context;
+        return context.compile(std::move(source), line_count);
+    }
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+// Embeddable API of the little_compiler pipeline.
+//
+// Compile an expression once, then evaluate it from any number of threads:
+//
+//     little::Context context;                  // one per thread
+//     auto expr = context.compile("2 * (-53 + 4)");
+//     if (expr->ok())
+//         double v = context.evaluate(*expr);  // -98
+//
+// CompiledExpression is immutable once built, so it can be shared freely
+// without locking. Contexts hold the scratch state of the lexer, parser and
+// binder, and are cheap to create, but must not be shared between threads.
+// There is no global mutable state.
+
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "binder.hpp"
+#include "evaluator.hpp"
+#include "budget.hpp"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace little
+{
+    class CompiledExpression
+    {
+    public:
+        CompiledExpression(std::string source, std::shared_ptr<const BoundNode> ast,
+                           std::string error_header, std::vector<std::string> diagnostics);
+
+        // True if the expression compiled without diagnostics, and can be evaluated
+        bool ok() const { return ast_ != nullptr; }
+
+        // True for lines with nothing to evaluate (empty or comment only)
+        bool empty() const { return ast_ == nullptr && diagnostics_.empty(); }
+
+        const std::string &source() const { return source_; }
+        const std::shared_ptr<const BoundNode> &ast() const { return ast_; }
+        Type type() const { return ast_->type_; }
+
+        // Phase that reported the diagnostics, ie "Lexer error:"
+        const std::string &error_header() const { return error_header_; }
+        const std::vector<std::string> &diagnostics() const { return diagnostics_; }
+
+    private:
+        const std::string source_;
+        const std::shared_ptr<const BoundNode> ast_;
+        const std::string error_header_;
+        const std::vector<std::string> diagnostics_;
+    };
+
+    // Per-thread compilation and evaluation state
+    class Context
+    {
+    public:
+        Context();
+
+        // Limits the work of every compile() and evaluate() call from now on.
+        // Each call gets the whole deadline. Breaches fail compile() with a
+        // "Budget error:" diagnostic, and make evaluate() throw BudgetExceeded.
+        void set_budget(const Budget &budget);
+        // Runs the lexer, parser and binder on a single line.
+        // line_count is the line number used in diagnostics.
+        std::shared_ptr<const CompiledExpression> compile(std::string source, unsigned int line_count = 0);
+
+        // Expression must be ok()
+        double evaluate(const CompiledExpression &expr) const;
+
+    private:
+        Lexer lexer_;
+        Parser parser_;
+        Binder binder_;
+        Evaluator evaluator_;
+        // On the heap, so that the pointers held by the phases survive moves
+        std::unique_ptr<BudgetMeter> meter_;
+    };
+
+    // Compiles with a temporary context
+    std::shared_ptr<const CompiledExpression> compile(std::string source, unsigned int line_count = 0);
+}
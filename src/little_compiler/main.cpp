@@ -2,101 +2,604 @@
 #include "parser.hpp"
 #include "binder.hpp"
 #include "evaluator.hpp"
+#include "fused_evaluator.hpp"
+#include "artifact_cache.hpp"
+#include "result_cache.hpp"
+#include "constexpr_pipeline.hpp"
+#include "reporter.hpp"
+#include "pipeline.hpp"
+#include "stats.hpp"
+#include "line_reader.hpp"
 
+#include <chrono>
+#include <csignal>
+#include <fstream>
 #include <vector>
 #include <string>
 #include <iostream>
-#include <fstream>
-
-int main(int argc, char *argv[])
-{
-
-    if (argc < 2)
-    {
-        std::cout << "No input file" << std::endl;
-        return -1;
-    }
+#include <memory>
 
-    std::cout << argv[0] << std::endl;
-    std::cout << "Input file: " << argv[1] << std::endl;
-    std::ifstream file(argv[1]);
+// Expressions known at build time never reach the runtime pipeline
+static_assert(little::eval("2 * (-53 + 4)") == -98, "constexpr pipeline disagrees with the runtime one");
 
-    std::string line;
-    Lexer lexer;
-    Parser parser;
-    Binder binder;
-    Evaluator evaluator;
+// Tokenizes a single null-terminated line, printing the tokens. Lexer
+// diagnostics and budget breaches are kept in artifact.
+std::vector<Token> lex_line(const char *line, Lexer &lexer, Reporter &reporter, Stats *stats, Artifact &artifact)
+{
+    artifact.line_count_ = lexer.get_line_count();
 
-    while (std::getline(file, line))
+    std::vector<Token> tokens;
+    try
     {
-        std::cout << "\nParsing next line: \n"
-                  << line << std::endl;
-
-        // Tokenize line
-        std::vector<Token> tokens = lexer.tokenize_line(std::move(line));
+        {
+            ScopedPhaseTimer timer(stats, Phase::lexing);
+            tokens = lexer.tokenize_line(line);
+        }
+        artifact.tokens_ = tokens.size();
+        count_tokens(stats, Phase::lexing, tokens.size());
+        count_diagnostics(stats, Phase::lexing, lexer.get_diagnostics().size());
 
         // Print tokens
-        for (auto &tok : tokens)
         {
-            std::cout << tok;
+            ScopedPhaseTimer timer(stats, Phase::printing);
+            reporter.tokens(tokens);
         }
-        std::cout << std::endl;
 
-        // Print diagnostics, if any
+        // Keep diagnostics, if any
         if (!lexer.get_diagnostics().empty())
         {
-            std::cout << "Lexer error:" << std::endl;
-            for (auto &msg : lexer.get_diagnostics())
-            {
-                std::cout << msg << std::endl;
-            }
-            continue;
+            artifact.error_header_ = "Lexer error:";
+            artifact.diagnostics_ = lexer.get_diagnostics();
         }
+    }
+    catch (const BudgetExceeded &e)
+    {
+        artifact.error_header_ = "Budget error:";
+        artifact.diagnostics_ = {e.what()};
+    }
+    return tokens;
+}
 
+// Runs the rest of the front end (parser, binder) on the tokens of a line
+// lexed without diagnostics, reporting intermediate results along the way.
+Artifact compile_tokens(std::vector<Token> tokens, unsigned int line_count, Parser &parser, Binder &binder,
+                        Reporter &reporter, Stats *stats)
+{
+    Artifact artifact;
+    artifact.line_count_ = line_count;
+    artifact.tokens_ = tokens.size();
+
+    try
+    {
         if (tokens.size() == 1 && tokens[0].tag_ == TokenTag::eof)
         {
-            // If empty line, continue to next line
-            continue;
+            // If empty line, there's nothing to compile
+            return artifact;
         }
 
         // Parse tokens
-        auto parse_tree = parser.parse(std::move(tokens));
+        std::shared_ptr<SyntaxNode> parse_tree;
+        {
+            ScopedPhaseTimer timer(stats, Phase::parsing);
+            parse_tree = parser.parse(std::move(tokens));
+        }
+        artifact.depth_ = parse_tree->height_;
+        artifact.nodes_ = parse_tree->size_;
+        count_nodes(stats, Phase::parsing, parse_tree->size_);
+        count_diagnostics(stats, Phase::parsing, parser.get_diagnostics().size());
 
         // Print result
-        std::cout << *parse_tree << std::endl;
+        {
+            ScopedPhaseTimer timer(stats, Phase::printing);
+            reporter.tree(*parse_tree);
+        }
 
-        // Print diagnostics, if any.
+        // Keep diagnostics, if any.
         if (!parser.get_diagnostics().empty())
         {
-            std::cout << "Parser error:" << std::endl;
-            for (auto &msg : parser.get_diagnostics())
-            {
-                std::cout << msg << std::endl;
-            }
-            continue;
+            artifact.error_header_ = "Parser error:";
+            artifact.diagnostics_ = parser.get_diagnostics();
+            return artifact;
         }
 
         // Bind parse tree
-        auto ast = binder.bind(parse_tree);
+        std::shared_ptr<BoundNode> ast;
+        {
+            ScopedPhaseTimer timer(stats, Phase::binding);
+            ast = binder.bind(parse_tree);
+        }
+        count_nodes(stats, Phase::binding, ast->size_);
+        count_diagnostics(stats, Phase::binding, binder.get_diagnostics().size());
 
         // // Print ast
         // std::cout << *ast << std::endl;
 
-        // Print diagnostics, if any.
+        // Keep diagnostics, if any.
         if (!binder.get_diagnostics().empty())
         {
-            std::cout << "Parser error:" << std::endl;
-            for (auto &msg : binder.get_diagnostics())
+            artifact.error_header_ = "Parser error:";
+            artifact.diagnostics_ = binder.get_diagnostics();
+            return artifact;
+        }
+
+        artifact.ast_ = ast;
+        return artifact;
+    }
+    catch (const BudgetExceeded &e)
+    {
+        // Only this line is aborted
+        artifact.error_header_ = "Budget error:";
+        artifact.diagnostics_ = {e.what()};
+        return artifact;
+    }
+}
+
+// Runs the front end (lexer, parser, binder) on a single null-terminated line,
+// reporting intermediate results along the way. Budget breaches are reported
+// as diagnostics.
+Artifact compile_line(const char *line, Lexer &lexer, Parser &parser, Binder &binder, Reporter &reporter,
+                      Stats *stats)
+{
+    Artifact artifact;
+    std::vector<Token> tokens = lex_line(line, lexer, reporter, stats, artifact);
+    if (!artifact.diagnostics_.empty())
+    {
+        return artifact;
+    }
+    return compile_tokens(std::move(tokens), artifact.line_count_, parser, binder, reporter, stats);
+}
+
+// Lexes a single null-terminated line, then parses and evaluates it in one
+// pass, reporting the result or diagnostics. Returns false, without reporting
+// anything, if the line needs the tree path after all; the lexer is then
+// rewound to the line.
+bool run_line_fused(const char *line, Lexer &lexer, FusedEvaluator &fused, Reporter &reporter, Stats *stats)
+{
+    unsigned int line_count = lexer.get_line_count();
+    std::string error_header;
+    double result = 0;
+    try
+    {
+        std::vector<Token> tokens;
+        {
+            ScopedPhaseTimer timer(stats, Phase::lexing);
+            tokens = lexer.tokenize_line(line);
+        }
+        count_tokens(stats, Phase::lexing, tokens.size());
+        count_diagnostics(stats, Phase::lexing, lexer.get_diagnostics().size());
+
+        if (!lexer.get_diagnostics().empty())
+        {
+            ScopedPhaseTimer timer(stats, Phase::printing);
+            reporter.diagnostics("Lexer error:", lexer.get_diagnostics());
+            return true;
+        }
+        if (tokens.size() == 1 && tokens[0].tag_ == TokenTag::eof)
+        {
+            return true;
+        }
+
+        // Binding and evaluation happen as part of parsing, and are counted there
+        FusedEvaluator::Status status;
+        {
+            ScopedPhaseTimer timer(stats, Phase::parsing);
+            status = fused.evaluate(tokens, result);
+        }
+        if (status == FusedEvaluator::Status::fallback)
+        {
+            lexer.set_line_count(line_count);
+            return false;
+        }
+        count_nodes(stats, Phase::parsing, fused.get_node_count());
+        if (status == FusedEvaluator::Status::parser_error || status == FusedEvaluator::Status::binder_error)
+        {
+            count_diagnostics(stats, status == FusedEvaluator::Status::parser_error ? Phase::parsing : Phase::binding,
+                              fused.get_diagnostics().size());
+            error_header = "Parser error:";
+        }
+    }
+    catch (const BudgetExceeded &e)
+    {
+        ScopedPhaseTimer timer(stats, Phase::printing);
+        reporter.diagnostics("Budget error:", {e.what()});
+        return true;
+    }
+
+    ScopedPhaseTimer timer(stats, Phase::printing);
+    if (!error_header.empty())
+    {
+        reporter.diagnostics(error_header, fused.get_diagnostics());
+    }
+    else
+    {
+        reporter.result(result);
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    std::string input_file;
+    std::unique_ptr<ArtifactCache> cache;
+    std::unique_ptr<ResultCache> results;
+    Verbosity verbosity = Verbosity::debug;
+    bool pipelined = false;
+    bool fused = false;
+    std::string profile_file;
+    size_t slowest_lines = 10;
+    bool perf_counters = false;
+    std::unique_ptr<Stats> stats;
+    size_t jobs = 1;
+    size_t fork_threshold = default_fork_threshold;
+    Budget budget;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--cache-dir=", 0) == 0)
+        {
+            cache = std::make_unique<ArtifactCache>(arg.substr(std::string("--cache-dir=").size()));
+        }
+        else if (arg.rfind("--result-cache=", 0) == 0)
+        {
+            size_t entries = std::stoul(arg.substr(std::string("--result-cache=").size()));
+            results = entries ? std::make_unique<ResultCache>(entries) : nullptr;
+        }
+        else if (arg == "--pipeline")
+        {
+            pipelined = true;
+        }
+        else if (arg == "--fused")
+        {
+            fused = true;
+        }
+        else if (arg.rfind("--profile=", 0) == 0)
+        {
+            profile_file = arg.substr(std::string("--profile=").size());
+        }
+        else if (arg == "--stats=json")
+        {
+            if (!LITTLE_COMPILER_STATS)
+            {
+                std::cout << "Built without stats support (LITTLE_COMPILER_STATS=0)" << std::endl;
+                return -1;
+            }
+            stats = std::make_unique<Stats>();
+        }
+        else if (arg == "--perf-counters")
+        {
+            perf_counters = true;
+        }
+        else if (arg.rfind("--slowest=", 0) == 0)
+        {
+            slowest_lines = std::stoul(arg.substr(std::string("--slowest=").size()));
+        }
+        else if (arg.rfind("--jobs=", 0) == 0)
+        {
+            jobs = std::stoul(arg.substr(std::string("--jobs=").size()));
+        }
+        else if (arg.rfind("--fork-threshold=", 0) == 0)
+        {
+            fork_threshold = std::stoul(arg.substr(std::string("--fork-threshold=").size()));
+        }
+        else if (parse_budget_flag(arg, budget))
+        {
+        }
+        else if (arg.rfind("--verbosity=", 0) == 0)
+        {
+            if (!parse_verbosity(arg.substr(std::string("--verbosity=").size()), verbosity))
+            {
+                std::cout << "Unknown verbosity: " << arg << std::endl;
+                return -1;
+            }
+        }
+        else
+        {
+            input_file = arg;
+        }
+    }
+
+    if (input_file.empty())
+    {
+        std::cout << "No input file" << std::endl;
+        std::cout << "Usage: " << argv[0] << " <input file, or - for stdin> [--cache-dir=<dir>]"
+                  << " [--result-cache=<entries>] [--verbosity=silent|results|diagnostics|debug] [--pipeline] [--fused] [--profile=<folded stacks file>]"
+                  << " [--stats=json] [--slowest=N] [--perf-counters] [--jobs=N] [--fork-threshold=N]"
+                  << " [--max-tokens=N] [--max-depth=N] [--max-nodes=N] [--max-steps=N] [--deadline-us=N]" << std::endl;
+        return -1;
+    }
+
+    if (perf_counters && !stats)
+    {
+        std::cout << "--perf-counters needs --stats=json" << std::endl;
+        return -1;
+    }
+
+    if (pipelined && cache)
+    {
+        std::cout << "--pipeline can't be combined with --cache-dir" << std::endl;
+        return -1;
+    }
+
+    if (results && (cache || pipelined))
+    {
+        std::cout << "--result-cache can't be combined with --cache-dir or --pipeline" << std::endl;
+        return -1;
+    }
+
+    // Opened up front, so a bad path fails before any input is read
+    std::unique_ptr<EvaluatorProfiler> profiler;
+    std::ofstream profile_out;
+    if (!profile_file.empty())
+    {
+        profile_out.open(profile_file);
+        if (!profile_out)
+        {
+            std::cout << "Can't open profile file: " << profile_file << std::endl;
+            return -1;
+        }
+        profiler = std::make_unique<EvaluatorProfiler>();
+    }
+
+    if (stats)
+    {
+        stats->set_result_cache(results.get());
+        stats->set_slowest_lines(slowest_lines);
+        if (perf_counters)
+        {
+            stats->enable_perf_counters();
+        }
+#ifdef SIGUSR1
+        // Long runs report latencies so far on SIGUSR1, ie kill -USR1 <pid>
+        struct sigaction action = {};
+        action.sa_handler = [](int)
+        { latency_report_requested = 1; };
+        sigemptyset(&action.sa_mask);
+        sigaction(SIGUSR1, &action, nullptr);
+#endif
+    }
+
+    // Output goes through one large buffer, without syncing with C stdio.
+    // It's flushed explicitly, once the whole input has been processed.
+    std::ios::sync_with_stdio(false);
+    static char out_buffer[1 << 20];
+    std::cout.rdbuf()->pubsetbuf(out_buffer, sizeof(out_buffer));
+    Reporter reporter(std::cout, verbosity);
+
+    if (reporter.enabled(Verbosity::debug))
+    {
+        std::cout << argv[0] << "\n";
+        std::cout << "Input file: " << input_file << "\n";
+    }
+    // Input is read ahead on a background thread, so it also streams well from pipes
+    int fd = LineReader::open_input(input_file);
+    if (fd < 0)
+    {
+        std::cout << "Can't open input file: " << input_file << std::endl;
+        return -1;
+    }
+    LineReader file(fd);
+
+    auto start = std::chrono::steady_clock::now();
+
+    // Reports stats, profile and read errors, and returns the exit code. All
+    // go to stderr (or their own file), so they're never mixed up with results.
+    auto finish = [&stats, &start, &file, &input_file, &profiler, &profile_out]()
+    {
+        if (profiler)
+        {
+            profiler->write_folded(profile_out);
+            profiler->write_summary(std::cerr);
+        }
+        if (stats)
+        {
+            stats->wall_ns_ = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                  std::chrono::steady_clock::now() - start)
+                                  .count();
+            stats->write_json(std::cerr);
+        }
+        if (file.failed())
+        {
+            std::cerr << "Error reading input file: " << input_file << std::endl;
+            return -1;
+        }
+        return 0;
+    };
+
+    // Huge expressions are bound and evaluated on several threads. The calling
+    // thread takes part too, so the pool has one worker less than jobs.
+    std::unique_ptr<WorkStealingPool> pool;
+    if (jobs > 1)
+    {
+        pool = std::make_unique<WorkStealingPool>(jobs - 1);
+    }
+
+    if (pipelined)
+    {
+        // Each compilation phase on its own thread
+        PipelinedCompiler compiler(reporter, stats.get(), pool.get(), fork_threshold);
+        compiler.set_budget(budget);
+        compiler.set_profiler(profiler.get());
+        compiler.run(file);
+        reporter.flush();
+        return finish();
+    }
+
+    // Lines are evaluated while parsing, unless something needs the trees:
+    // debug output prints them, the caches store them, and profiles are per node
+    fused = fused && !cache && !results && !profiler && !reporter.enabled(Verbosity::debug);
+
+    std::string_view line;
+    Lexer lexer;
+    Parser parser;
+    Binder binder(pool.get(), fork_threshold);
+    Evaluator evaluator(pool.get(), fork_threshold);
+    FusedEvaluator fused_evaluator;
+
+    // Every line gets the whole budget, from lexing to evaluation
+    BudgetMeter meter(budget);
+    if (budget.limited())
+    {
+        lexer.set_budget(&meter);
+        parser.set_budget(&meter);
+        binder.set_budget(&meter);
+        evaluator.set_budget(&meter);
+        fused_evaluator.set_budget(&meter);
+    }
+    evaluator.set_profiler(profiler.get());
+
+    while (file.next_line(line))
+    {
+        meter.start();
+        report_latency_if_requested(stats.get(), std::cerr);
+        if (stats)
+        {
+            stats->lines_++;
+        }
+        ScopedLineTimer line_timer(stats.get(), stats ? stats->lines_ - 1 : 0);
+        {
+            ScopedPhaseTimer timer(stats.get(), Phase::printing);
+            reporter.line(line);
+        }
+
+        if (fused && run_line_fused(line.data(), lexer, fused_evaluator, reporter, stats.get()))
+        {
+            continue;
+        }
+
+        // On a cache hit, skip the front end entirely
+        std::unique_ptr<Artifact> artifact;
+        std::string raw_key;
+        std::string result_key;
+        if (cache)
+        {
+            std::string source(line);
+            try
+            {
+                artifact = cache->load(source, lexer.get_line_count(), budget.limited() ? &meter : nullptr);
+            }
+            catch (const BudgetExceeded &)
+            {
+                // Compiled again below, to report the breach as usual
+            }
+            if (artifact)
+            {
+                reporter.note("Loaded from cache");
+                lexer.skip_line();
+            }
+            else
+            {
+                artifact = std::make_unique<Artifact>(compile_line(line.data(), lexer, parser, binder, reporter, stats.get()));
+                // Budget errors depend on the settings (and timing) of this
+                // run, so aren't kept. Hits are held to the same limits.
+                if (artifact->error_header_ != "Budget error:")
+                {
+                    cache->store(source, *artifact);
+                }
+            }
+        }
+        else if (results)
+        {
+            // Results only depend on the tokens of a line. Exact repeats are
+            // found without lexing, others as soon as they're lexed.
+            CachedResult hit;
+            raw_key = ResultCache::raw_key(line);
+            bool found = results->find(raw_key, hit);
+            if (found)
             {
-                std::cout << msg << std::endl;
+                lexer.skip_line();
             }
+            else
+            {
+                artifact = std::make_unique<Artifact>();
+                std::vector<Token> tokens = lex_line(line.data(), lexer, reporter, stats.get(), *artifact);
+                if (!artifact->diagnostics_.empty())
+                {
+                    raw_key.clear();
+                }
+                else
+                {
+                    result_key = ResultCache::normalize(tokens);
+                    found = !result_key.empty() && results->find(result_key, hit);
+                    if (found)
+                    {
+                        results->insert(raw_key, hit);
+                    }
+                    else
+                    {
+                        *artifact = compile_tokens(std::move(tokens), artifact->line_count_, parser, binder,
+                                                   reporter, stats.get());
+                    }
+                }
+            }
+            if (found)
+            {
+                reporter.note("Loaded from result cache");
+                ScopedPhaseTimer timer(stats.get(), Phase::printing);
+                if (hit.error_header_.empty())
+                    reporter.result(hit.value_);
+                else
+                    reporter.diagnostics(hit.error_header_, hit.diagnostics_);
+                continue;
+            }
+            // Binder diagnostics don't mention positions, so they're the only
+            // ones that hold for every line with the same tokens
+            if (!artifact->diagnostics_.empty() && !result_key.empty())
+            {
+                if (artifact->error_header_ == "Parser error:" && parser.get_diagnostics().empty())
+                {
+                    CachedResult outcome{0, artifact->error_header_, artifact->diagnostics_};
+                    results->insert(raw_key, outcome);
+                    results->insert(result_key, std::move(outcome));
+                }
+            }
+        }
+        else
+        {
+            artifact = std::make_unique<Artifact>(compile_line(line.data(), lexer, parser, binder, reporter, stats.get()));
+        }
+
+        // Print diagnostics, if any
+        if (!artifact->diagnostics_.empty())
+        {
+            ScopedPhaseTimer timer(stats.get(), Phase::printing);
+            reporter.diagnostics(artifact->error_header_, artifact->diagnostics_);
+            continue;
+        }
+
+        if (!artifact->ast_)
+        {
+            // If empty line, continue to next line
             continue;
         }
 
         // Evaluate
-        auto result = evaluator.evaluate_expression(ast);
-        std::cout << "Evaluated: " << result << std::endl;
+        double result;
+        try
+        {
+            ScopedPhaseTimer timer(stats.get(), Phase::evaluating);
+            result = evaluator.evaluate_expression(*artifact->ast_);
+        }
+        catch (const BudgetExceeded &e)
+        {
+            ScopedPhaseTimer timer(stats.get(), Phase::printing);
+            reporter.diagnostics("Budget error:", {e.what()});
+            continue;
+        }
+        count_nodes(stats.get(), Phase::evaluating, artifact->ast_->size_);
+        if (!result_key.empty())
+        {
+            results->insert(raw_key, CachedResult{result, "", {}});
+            results->insert(result_key, CachedResult{result, "", {}});
+        }
+
+        ScopedPhaseTimer timer(stats.get(), Phase::printing);
+        reporter.result(result);
     }
 
-    return 0;
+    {
+        ScopedPhaseTimer timer(stats.get(), Phase::printing);
+        reporter.flush();
+    }
+    return finish();
 }
@@ -1,7 +1,9 @@
 #pragma once
 // #include "lexer.hpp"
 #include "syntax_elements.hpp"
+#include "budget.hpp"
 
+#include <algorithm>
 #include <string>
 #include <vector>
 #include <sstream>
@@ -60,7 +62,7 @@ private:
         return Token(TokenTag::bad, current().line_count_, current().char_count_);
     }
 
-    std::shared_ptr<SyntaxNode> parse_primary_expression(int order = 0)
+    std::shared_ptr<SyntaxNode> parse_primary_expression()
     {
 
         if (current().tag_ == TokenTag::parenthesis_open)
@@ -68,7 +70,7 @@ private:
             Token open = match(TokenTag::parenthesis_open);
             auto expr = parse_expression(0);
             Token close = match(TokenTag::parenthesis_close);
-            return std::make_shared<ParenthesizedExpression>(open, expr, close);
+            return checked(std::make_shared<ParenthesizedExpression>(open, expr, close));
         }
 
         const std::vector<TokenTag> primary_expr_token_tags = {TokenTag::val_double, TokenTag::val_int, TokenTag::id};
@@ -82,16 +84,46 @@ private:
         {
             return std::make_shared<BooleanExpression>(tok);
         }
-        else if (tok.tag_ == TokenTag::bad)
+        else if (tok.tag_ == TokenTag::id)
         {
-            return std::make_shared<IntegerExpression>(tok); // Unkown tokens are filled in as ints
+            std::stringstream err;
+            err << "Error: Unknown identifier (" << tok.val_ << ") at (" << tok.line_count_ << ", "
+                << tok.char_count_ << ")";
+            diagnostics_.push_back(err.str());
         }
-        std::cout << "Unreachable" << std::endl;
-        throw "Unreachable";
+        return std::make_shared<IntegerExpression>(tok); // Unkown tokens are filled in as ints
+    }
+
+    // Counts one more node, at the current depth
+    void check_budget()
+    {
+        nodes_++;
+        budget_->check_nodes(nodes_, current().line_count_, current().char_count_);
+        budget_->check_depth(depth_, current().line_count_, current().char_count_);
+        budget_->tick(Phase::parsing);
+    }
+
+    // Checks the height of a node just built. Recursion depth alone misses
+    // chains like 1 + 1 + ... + 1, built in a loop but as deep as they're long.
+    std::shared_ptr<SyntaxNode> checked(std::shared_ptr<SyntaxNode> node)
+    {
+        if (budget_)
+        {
+            budget_->check_depth(node->height_, current().line_count_, current().char_count_);
+        }
+        return node;
     }
 
     std::shared_ptr<SyntaxNode> parse_expression(int order = 0)
     {
+        // Every call makes one node (unary or primary), and so does every
+        // binary operator below
+        if (budget_)
+        {
+            depth_++;
+            check_budget();
+        }
+
         std::shared_ptr<SyntaxNode> left;
 
         // Handle unary operators
@@ -101,7 +133,7 @@ private:
             // Current token is a unary operator
             Token op = next();
             auto expr = parse_expression(precedence);
-            left = std::make_shared<UnaryExpression>(op, expr);
+            left = checked(std::make_shared<UnaryExpression>(op, expr));
         }
         else
         {
@@ -115,10 +147,18 @@ private:
             if (precedence == 0 || precedence <= order)
                 break;
             // Current token is a binary operator
+            if (budget_)
+            {
+                check_budget();
+            }
             Token op = current();
             next();
             auto right = parse_expression(precedence);
-            left = std::make_unique<BinaryExpression>(left, op, right);
+            left = checked(std::make_shared<BinaryExpression>(left, op, right));
+        }
+        if (budget_)
+        {
+            depth_--;
         }
         return left;
     }
@@ -130,6 +170,8 @@ public:
         tokens_ = std::move(tokens);
         p_ = 0;
         diagnostics_.clear();
+        depth_ = 0;
+        nodes_ = 0;
 
         auto parse_tree = parse_expression();
 
@@ -142,8 +184,17 @@ public:
         return diagnostics_;
     }
 
+    // Limits depth, nodes and time of every parse from now on (nullptr for none)
+    void set_budget(const BudgetMeter *budget)
+    {
+        budget_ = budget;
+    }
+
 private:
     std::vector<Token> tokens_;
     size_t p_;
     std::vector<std::string> diagnostics_;
+    const BudgetMeter *budget_ = nullptr;
+    size_t depth_ = 0; // Only tracked with a budget, as is nodes_
+    size_t nodes_ = 0;
 };
@@ -0,0 +1,281 @@
+#pragma once
+
+// Hardware performance counters of the calling thread, through Linux
+// perf_event_open.
+//
+// Where the PMU isn't available (containers, VMs, perf_event_paranoid...),
+// falls back to perf's software events, then to getrusage() and the thread's
+// CPU clock, and elsewhere to nothing; source() tells which one is in use,
+// and available() which events it counts. Only user space is counted, but
+// for task_clock: CPU time, which includes the kernel's, like the thread's
+// CPU clock.
+//
+// Events are opened as one group, so they count over the same spans and a
+// sample is a single read() of the group leader.
+
+#include <cstdint>
+#include <ostream>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <ctime>
+#endif
+
+enum class PerfEvent
+{
+    cycles,
+    instructions,
+    branch_misses,
+    l1d_misses, // L1 data cache, reads
+    llc_misses, // Last level cache, reads
+    page_faults,
+    task_clock, // CPU time in ns
+    count
+};
+
+inline const char *perf_event_name(PerfEvent event)
+{
+    static const char *names[] = {"cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses",
+                                  "page_faults", "task_clock_ns"};
+    return names[static_cast<int>(event)];
+}
+
+// Values of every event at some point, or between two points
+struct PerfSample
+{
+    uint64_t values_[static_cast<int>(PerfEvent::count)] = {};
+
+    uint64_t operator[](PerfEvent event) const
+    {
+        return values_[static_cast<int>(event)];
+    }
+
+    PerfSample operator-(const PerfSample &other) const
+    {
+        PerfSample diff;
+        for (int i = 0; i < static_cast<int>(PerfEvent::count); i++)
+        {
+            diff.values_[i] = values_[i] - other.values_[i];
+        }
+        return diff;
+    }
+
+    PerfSample &operator+=(const PerfSample &other)
+    {
+        for (int i = 0; i < static_cast<int>(PerfEvent::count); i++)
+        {
+            values_[i] += other.values_[i];
+        }
+        return *this;
+    }
+};
+
+class PerfCounters
+{
+public:
+    enum class Source
+    {
+        hardware, // PMU events, plus software ones
+        software, // perf software events only
+        rusage,   // getrusage() and the thread CPU clock
+        none
+    };
+
+    static const char *source_name(Source source)
+    {
+        switch (source)
+        {
+        case Source::hardware:
+            return "hardware";
+        case Source::software:
+            return "software";
+        case Source::rusage:
+            return "rusage";
+        default:
+            return "none";
+        }
+    }
+
+    // Starts counting for the calling thread. Reads must come from the same thread.
+    PerfCounters()
+    {
+#if defined(__linux__)
+        constexpr uint64_t l1d_read_miss = PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        constexpr uint64_t llc_read_miss = PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) |
+                                           (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+        open(PerfEvent::cycles, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES);
+        open(PerfEvent::instructions, PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS);
+        open(PerfEvent::branch_misses, PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES);
+        open(PerfEvent::l1d_misses, PERF_TYPE_HW_CACHE, l1d_read_miss);
+        open(PerfEvent::llc_misses, PERF_TYPE_HW_CACHE, llc_read_miss);
+        bool hardware = leader_ >= 0;
+        open(PerfEvent::page_faults, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS);
+        open(PerfEvent::task_clock, PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK);
+        bool software = leader_ >= 0;
+
+        if (hardware)
+            source_ = Source::hardware;
+        else if (software)
+            source_ = Source::software;
+        else
+            source_ = Source::rusage;
+#endif
+    }
+
+    ~PerfCounters()
+    {
+#if defined(__linux__)
+        for (int fd : fds_)
+        {
+            if (fd >= 0)
+            {
+                ::close(fd);
+            }
+        }
+#endif
+    }
+
+    PerfCounters(const PerfCounters &) = delete;
+    PerfCounters &operator=(const PerfCounters &) = delete;
+
+    Source source() const
+    {
+        return source_;
+    }
+
+    bool available(PerfEvent event) const
+    {
+        switch (source_)
+        {
+        case Source::hardware:
+        case Source::software:
+            return fds_[static_cast<int>(event)] >= 0;
+        case Source::rusage:
+            return event == PerfEvent::page_faults || event == PerfEvent::task_clock;
+        default:
+            return false;
+        }
+    }
+
+    // Counts since the counters were opened (0 for unavailable events)
+    PerfSample read() const
+    {
+        PerfSample sample;
+#if defined(__linux__)
+        if (source_ == Source::rusage)
+        {
+            rusage usage;
+            getrusage(RUSAGE_THREAD, &usage);
+            timespec ts;
+            clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+            sample.values_[static_cast<int>(PerfEvent::page_faults)] = usage.ru_minflt + usage.ru_majflt;
+            sample.values_[static_cast<int>(PerfEvent::task_clock)] =
+                static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+            return sample;
+        }
+        if (leader_ < 0)
+        {
+            return sample;
+        }
+        // Event count, time enabled, time running, then the values in the
+        // order the events joined the group
+        uint64_t data[3 + static_cast<int>(PerfEvent::count)];
+        ssize_t size = static_cast<ssize_t>((3 + group_size_) * sizeof(uint64_t));
+        if (::read(leader_, data, sizeof(data)) != size || data[2] == 0)
+        {
+            return sample;
+        }
+        // When other groups compete for the PMU, the kernel time-shares it:
+        // scale up to the whole time the group was enabled
+        for (int i = 0; i < static_cast<int>(PerfEvent::count); i++)
+        {
+            if (fds_[i] >= 0)
+            {
+                uint64_t value = data[3 + slot_[i]];
+                sample.values_[i] = data[1] == data[2]
+                                        ? value
+                                        : static_cast<uint64_t>(static_cast<double>(value) * data[1] / data[2]);
+            }
+        }
+#endif
+        return sample;
+    }
+
+    // Fields of every available event, and the rates derived from them, as
+    // JSON object members (ie "cycles": 123, "ipc": 1.5)
+    void write_json_fields(std::ostream &out, const PerfSample &sample) const
+    {
+        const char *separator = "";
+        for (int i = 0; i < static_cast<int>(PerfEvent::count); i++)
+        {
+            if (available(static_cast<PerfEvent>(i)))
+            {
+                out << separator << "\"" << perf_event_name(static_cast<PerfEvent>(i)) << "\": " << sample.values_[i];
+                separator = ", ";
+            }
+        }
+        uint64_t instructions = sample[PerfEvent::instructions];
+        if (available(PerfEvent::cycles) && available(PerfEvent::instructions) && sample[PerfEvent::cycles])
+        {
+            out << separator << "\"ipc\": " << static_cast<double>(instructions) / sample[PerfEvent::cycles];
+        }
+        // Misses per thousand instructions
+        if (available(PerfEvent::instructions) && instructions)
+        {
+            if (available(PerfEvent::l1d_misses))
+                out << ", \"l1d_mpki\": " << sample[PerfEvent::l1d_misses] * 1000.0 / instructions;
+            if (available(PerfEvent::llc_misses))
+                out << ", \"llc_mpki\": " << sample[PerfEvent::llc_misses] * 1000.0 / instructions;
+            if (available(PerfEvent::branch_misses))
+                out << ", \"branch_mpki\": " << sample[PerfEvent::branch_misses] * 1000.0 / instructions;
+        }
+    }
+
+private:
+#if defined(__linux__)
+    void open(PerfEvent event, uint32_t type, uint64_t config)
+    {
+        perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = type;
+        attr.config = config;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        // This thread only, on any CPU. The first event opened leads the
+        // group; an event the group can't fit alongside the others fails.
+        long fd = syscall(__NR_perf_event_open, &attr, 0, -1, leader_, 0);
+        if (fd < 0)
+        {
+            return;
+        }
+        int i = static_cast<int>(event);
+        fds_[i] = static_cast<int>(fd);
+        slot_[i] = group_size_++;
+        if (leader_ < 0)
+        {
+            leader_ = fds_[i];
+        }
+    }
+#endif
+
+    int fds_[static_cast<int>(PerfEvent::count)] = {-1, -1, -1, -1, -1, -1, -1};
+    int slot_[static_cast<int>(PerfEvent::count)] = {}; // Position in a group read
+    int leader_ = -1;
+    int group_size_ = 0;
+    Source source_ = Source::none;
+};
+
+// Counters of the calling thread, opened on first use
+inline PerfCounters &thread_perf_counters()
+{
+    static thread_local PerfCounters counters;
+    return counters;
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+// Steps of processing a line, as seen by the instrumentation
+enum class Phase
+{
+    lexing,
+    parsing,
+    binding,
+    evaluating,
+    printing,
+    count
+};
+
+inline const char *phase_name(Phase phase)
+{
+    switch (phase)
+    {
+    case Phase::lexing:
+        return "lexing";
+    case Phase::parsing:
+        return "parsing";
+    case Phase::binding:
+        return "binding";
+    case Phase::evaluating:
+        return "evaluating";
+    case Phase::printing:
+        return "printing";
+    default:
+        return "unknown";
+    }
+}
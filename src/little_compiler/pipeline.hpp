@@ -0,0 +1,324 @@
+#pragma once
+
+#include "lexer.hpp"
+#include "parser.hpp"
+#include "binder.hpp"
+#include "evaluator.hpp"
+#include "artifact_cache.hpp"
+#include "reporter.hpp"
+#include "spsc_queue.hpp"
+#include "stats.hpp"
+#include "line_reader.hpp"
+
+#include <chrono>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Runs the lexer, parser, binder and evaluator as concurrent stages, each on
+// its own thread, so that consecutive lines overlap: while line n is being
+// evaluated, line n+1 is being bound, line n+2 parsed, and so on.
+//
+// Lines travel between stages in batches, through single-producer/
+// single-consumer queues. Batches are handed over by pointer, and each stage
+// moves its results into the batch, so nothing is copied along the way.
+// Output is identical to running the stages one after another.
+class PipelinedCompiler
+{
+public:
+    // Every stage updates its own phase in stats, so one Stats is enough.
+    // With a pool, huge expressions are also bound and evaluated in parallel.
+    PipelinedCompiler(Reporter &reporter, Stats *stats = nullptr, WorkStealingPool *pool = nullptr,
+                      size_t fork_threshold = default_fork_threshold, size_t batch_size = 256)
+        : reporter_(reporter), stats_(stats), pool_(pool), fork_threshold_(fork_threshold), batch_size_(batch_size) {}
+
+    // Limits every line, across all stages (time spent waiting between
+    // stages excluded)
+    void set_budget(const Budget &budget)
+    {
+        budget_ = budget;
+    }
+
+    // Profiles evaluations, all of which happen on the evaluator stage's thread
+    void set_profiler(EvaluatorProfiler *profiler)
+    {
+        profiler_ = profiler;
+    }
+
+    // Processes every line of in, and returns once all of them are reported
+    void run(LineReader &in)
+    {
+        std::thread lexer([this]()
+                          { lex_stage(); });
+        std::thread parser([this]()
+                           { parse_stage(); });
+        std::thread binder([this]()
+                           { bind_stage(); });
+        std::thread evaluator([this]()
+                              { evaluate_stage(); });
+        std::thread printer([this]()
+                            { print_stage(); });
+
+        // Read stage runs on the calling thread
+        auto batch = std::make_unique<LineBatch>();
+        std::string_view line;
+        while (in.next_line(line))
+        {
+            batch->lines_.emplace_back();
+            batch->lines_.back().text_ = line;
+            if (stats_)
+            {
+                stats_->lines_++;
+            }
+            if (batch->lines_.size() == batch_size_)
+            {
+                to_lexer_.push(std::move(batch));
+                batch = std::make_unique<LineBatch>();
+            }
+        }
+        if (!batch->lines_.empty())
+        {
+            to_lexer_.push(std::move(batch));
+        }
+        // An empty pointer marks the end of the stream, and is passed along by each stage
+        to_lexer_.push(nullptr);
+
+        lexer.join();
+        parser.join();
+        binder.join();
+        evaluator.join();
+        printer.join();
+    }
+
+private:
+    // One line, and everything computed for it so far
+    struct LineWork
+    {
+        std::string text_;
+        std::string debug_; // Tokens and syntax tree, rendered in debug verbosity only
+        std::vector<Token> tokens_;
+        std::shared_ptr<SyntaxNode> parse_tree_;
+        Artifact artifact_;
+        double result_ = 0;
+        std::chrono::nanoseconds spent_{0}; // Time spent in stages so far, with a deadline
+        std::chrono::nanoseconds busy_{0};              // Time spent in stages so far, with stats
+    };
+
+    struct LineBatch
+    {
+        std::vector<LineWork> lines_;
+    };
+
+    using BatchPtr = std::unique_ptr<LineBatch>;
+    using Queue = SpscQueue<BatchPtr, 8>;
+
+    // Runs fn on every line that is still compiling without errors, and
+    // forwards batches from in to out until the end of the stream. Lines that
+    // go over budget fail with a diagnostic. fn times its work as phase.
+    template <typename Fn>
+    void stage(Queue &in, Queue &out, Phase phase, BudgetMeter &meter, Fn fn)
+    {
+        while (BatchPtr batch = in.pop())
+        {
+            for (auto &work : batch->lines_)
+            {
+                if (!work.artifact_.diagnostics_.empty())
+                {
+                    continue;
+                }
+                meter.start(work.spent_);
+                auto start = stats_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+                try
+                {
+                    fn(work);
+                }
+                catch (const BudgetExceeded &e)
+                {
+                    work.artifact_.error_header_ = "Budget error:";
+                    work.artifact_.diagnostics_ = {e.what()};
+                    work.artifact_.ast_ = nullptr;
+                    work.parse_tree_ = nullptr;
+                }
+                work.spent_ = meter.elapsed();
+                if (stats_)
+                {
+                    work.busy_ += std::chrono::steady_clock::now() - start;
+                    stats_->end_line_phase(phase);
+                }
+            }
+            out.push(std::move(batch));
+        }
+        out.push(nullptr);
+    }
+
+    void lex_stage()
+    {
+        Lexer lexer;
+        BudgetMeter meter(budget_);
+        if (budget_.limited())
+        {
+            lexer.set_budget(&meter);
+        }
+        stage(to_lexer_, to_parser_, Phase::lexing, meter, [this, &lexer](LineWork &work)
+              {
+            work.artifact_.line_count_ = lexer.get_line_count();
+            {
+                ScopedPhaseTimer timer(stats_, Phase::lexing);
+                work.tokens_ = lexer.tokenize_line(work.text_.c_str());
+            }
+            count_tokens(stats_, Phase::lexing, work.tokens_.size());
+            count_diagnostics(stats_, Phase::lexing, lexer.get_diagnostics().size());
+            if (reporter_.enabled(Verbosity::debug))
+            {
+                std::stringstream debug;
+                Reporter(debug, Verbosity::debug).tokens(work.tokens_);
+                work.debug_ = debug.str();
+            }
+            if (!lexer.get_diagnostics().empty())
+            {
+                work.artifact_.error_header_ = "Lexer error:";
+                work.artifact_.diagnostics_ = lexer.get_diagnostics();
+            } });
+    }
+
+    void parse_stage()
+    {
+        Parser parser;
+        BudgetMeter meter(budget_);
+        if (budget_.limited())
+        {
+            parser.set_budget(&meter);
+        }
+        stage(to_parser_, to_binder_, Phase::parsing, meter, [this, &parser](LineWork &work)
+              {
+            if (work.tokens_.size() == 1 && work.tokens_[0].tag_ == TokenTag::eof)
+            {
+                // If empty line, there's nothing to compile
+                return;
+            }
+            {
+                ScopedPhaseTimer timer(stats_, Phase::parsing);
+                work.parse_tree_ = parser.parse(std::move(work.tokens_));
+            }
+            count_nodes(stats_, Phase::parsing, work.parse_tree_->size_);
+            count_diagnostics(stats_, Phase::parsing, parser.get_diagnostics().size());
+            if (reporter_.enabled(Verbosity::debug))
+            {
+                std::stringstream debug;
+                Reporter(debug, Verbosity::debug).tree(*work.parse_tree_);
+                work.debug_ += debug.str();
+            }
+            if (!parser.get_diagnostics().empty())
+            {
+                work.artifact_.error_header_ = "Parser error:";
+                work.artifact_.diagnostics_ = parser.get_diagnostics();
+                work.parse_tree_ = nullptr;
+            } });
+    }
+
+    void bind_stage()
+    {
+        Binder binder(pool_, fork_threshold_);
+        BudgetMeter meter(budget_);
+        if (budget_.limited())
+        {
+            binder.set_budget(&meter);
+        }
+        stage(to_binder_, to_evaluator_, Phase::binding, meter, [this, &binder](LineWork &work)
+              {
+            if (!work.parse_tree_)
+            {
+                return;
+            }
+            std::shared_ptr<BoundNode> ast;
+            {
+                ScopedPhaseTimer timer(stats_, Phase::binding);
+                ast = binder.bind(std::move(work.parse_tree_));
+            }
+            count_nodes(stats_, Phase::binding, ast->size_);
+            count_diagnostics(stats_, Phase::binding, binder.get_diagnostics().size());
+            if (!binder.get_diagnostics().empty())
+            {
+                work.artifact_.error_header_ = "Parser error:";
+                work.artifact_.diagnostics_ = binder.get_diagnostics();
+                return;
+            }
+            work.artifact_.ast_ = std::move(ast); });
+    }
+
+    void evaluate_stage()
+    {
+        Evaluator evaluator(pool_, fork_threshold_);
+        BudgetMeter meter(budget_);
+        if (budget_.limited())
+        {
+            evaluator.set_budget(&meter);
+        }
+        evaluator.set_profiler(profiler_);
+        stage(to_evaluator_, to_printer_, Phase::evaluating, meter, [this, &evaluator](LineWork &work)
+              {
+            if (work.artifact_.ast_)
+            {
+                ScopedPhaseTimer timer(stats_, Phase::evaluating);
+                work.result_ = evaluator.evaluate_expression(*work.artifact_.ast_);
+                count_nodes(stats_, Phase::evaluating, work.artifact_.ast_->size_);
+            } });
+    }
+
+    // Reports lines in input order
+    void print_stage()
+    {
+        Queue &in = to_printer_;
+        while (BatchPtr batch = in.pop())
+        {
+            for (auto &work : batch->lines_)
+            {
+                auto start = stats_ ? std::chrono::steady_clock::now() : std::chrono::steady_clock::time_point();
+                {
+                    ScopedPhaseTimer timer(stats_, Phase::printing);
+                    reporter_.line(work.text_);
+                    if (reporter_.enabled(Verbosity::debug))
+                    {
+                        reporter_.raw(work.debug_);
+                    }
+                    if (!work.artifact_.diagnostics_.empty())
+                    {
+                        reporter_.diagnostics(work.artifact_.error_header_, work.artifact_.diagnostics_);
+                    }
+                    else if (work.artifact_.ast_)
+                    {
+                        reporter_.result(work.result_);
+                    }
+                }
+                if (stats_)
+                {
+                    // Time spent waiting between stages isn't counted, it
+                    // says more about the neighbouring lines than this one
+                    work.busy_ += std::chrono::steady_clock::now() - start;
+                    stats_->end_line_phase(Phase::printing);
+                    stats_->end_line(work.artifact_.line_count_, work.busy_.count());
+                }
+            }
+            if (stats_)
+            {
+                report_latency_if_requested(stats_, std::cerr);
+            }
+        }
+    }
+
+    Reporter &reporter_;
+    Stats *stats_;
+    WorkStealingPool *pool_;
+    size_t fork_threshold_;
+    size_t batch_size_;
+    Budget budget_;
+    EvaluatorProfiler *profiler_ = nullptr;
+
+    Queue to_lexer_;
+    Queue to_parser_;
+    Queue to_binder_;
+    Queue to_evaluator_;
+    Queue to_printer_;
+};
@@ -0,0 +1,127 @@
+#pragma once
+
+// Wire protocol shared by little_server and little_client.
+//
+// Both directions carry frames: a 4 byte length in network byte order,
+// followed by that many bytes of payload.
+// A request payload holds one or more expressions, separated by '\n'.
+// The response to a request holds exactly one line per expression, in order:
+//   ok\t<result>
+//   error\t<header>\t<diagnostic>\t<diagnostic>...
+//   empty                                             (nothing to evaluate)
+// Expressions are compiled independently of their place in the request, so
+// diagnostics always report positions on line 0.
+// A connection may send several requests without waiting for responses;
+// responses come back in request order.
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+namespace protocol
+{
+    // Frames larger than this are treated as a protocol error
+    constexpr uint32_t max_frame_size = 64u << 20;
+
+    inline bool write_all(int fd, const char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    inline bool read_all(int fd, char *data, size_t size)
+    {
+        while (size > 0)
+        {
+            ssize_t n = ::read(fd, data, size);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                return false;
+            data += n;
+            size -= n;
+        }
+        return true;
+    }
+
+    inline bool write_frame(int fd, const std::string &payload)
+    {
+        uint32_t size = htonl(static_cast<uint32_t>(payload.size()));
+        return write_all(fd, reinterpret_cast<const char *>(&size), sizeof(size)) &&
+               write_all(fd, payload.data(), payload.size());
+    }
+
+    // Returns false on end of stream, or on a malformed frame
+    inline bool read_frame(int fd, std::string &payload)
+    {
+        uint32_t size;
+        if (!read_all(fd, reinterpret_cast<char *>(&size), sizeof(size)))
+            return false;
+        size = ntohl(size);
+        if (size > max_frame_size)
+            return false;
+        payload.resize(size);
+        return read_all(fd, &payload[0], size);
+    }
+
+    inline bool make_address(const std::string &path, sockaddr_un &addr)
+    {
+        if (path.size() >= sizeof(addr.sun_path))
+            return false;
+        std::memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        std::memcpy(addr.sun_path, path.c_str(), path.size() + 1);
+        return true;
+    }
+
+    // Returns a connected socket, or -1
+    inline int connect_to(const std::string &path)
+    {
+        sockaddr_un addr;
+        if (!make_address(path, addr))
+            return -1;
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        if (::connect(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    // Returns a listening socket bound to path, or -1
+    inline int listen_on(const std::string &path, int backlog)
+    {
+        sockaddr_un addr;
+        if (!make_address(path, addr))
+            return -1;
+        int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd < 0)
+            return -1;
+        ::unlink(path.c_str());
+        if (::bind(fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0 ||
+            ::listen(fd, backlog) < 0)
+        {
+            ::close(fd);
+            return -1;
+        }
+        return fd;
+    }
+}
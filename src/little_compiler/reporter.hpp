@@ -0,0 +1,113 @@
+#pragma once
+
+#include "token.hpp"
+#include "syntax_elements.hpp"
+
+#include <iostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// How much of the compilation is printed, from nothing up to full dumps of
+// every intermediate step.
+enum class Verbosity
+{
+    silent,
+    results,     // Evaluated results only
+    diagnostics, // Results, and diagnostics of lines that failed to compile
+    debug        // Everything: raw lines, tokens, syntax trees
+};
+
+inline bool parse_verbosity(const std::string &str, Verbosity &verbosity)
+{
+    if (str == "silent")
+        verbosity = Verbosity::silent;
+    else if (str == "results")
+        verbosity = Verbosity::results;
+    else if (str == "diagnostics")
+        verbosity = Verbosity::diagnostics;
+    else if (str == "debug")
+        verbosity = Verbosity::debug;
+    else
+        return false;
+    return true;
+}
+
+// Prints the outcome of each compilation step, filtered by verbosity.
+// Never flushes on its own: output is meant to go through a large buffer, and
+// is flushed explicitly by calling flush().
+class Reporter
+{
+public:
+    Reporter(std::ostream &out, Verbosity verbosity)
+        : out_(out), verbosity_(verbosity) {}
+
+    bool enabled(Verbosity level) const
+    {
+        return verbosity_ >= level;
+    }
+
+    void line(std::string_view line)
+    {
+        if (enabled(Verbosity::debug))
+            out_ << "\nParsing next line: \n"
+                 << line << "\n";
+    }
+
+    void tokens(const std::vector<Token> &tokens)
+    {
+        if (enabled(Verbosity::debug))
+        {
+            for (auto &tok : tokens)
+            {
+                out_ << tok;
+            }
+            out_ << "\n";
+        }
+    }
+
+    void tree(const SyntaxNode &node)
+    {
+        if (enabled(Verbosity::debug))
+            out_ << node << "\n";
+    }
+
+    // Output that was already rendered elsewhere (ie on another thread)
+    void raw(const std::string &text)
+    {
+        out_ << text;
+    }
+
+    void note(const char *msg)
+    {
+        if (enabled(Verbosity::debug))
+            out_ << msg << "\n";
+    }
+
+    void diagnostics(const std::string &header, const std::vector<std::string> &diagnostics)
+    {
+        if (enabled(Verbosity::diagnostics))
+        {
+            out_ << header << "\n";
+            for (auto &msg : diagnostics)
+            {
+                out_ << msg << "\n";
+            }
+        }
+    }
+
+    void result(double result)
+    {
+        if (enabled(Verbosity::results))
+            out_ << "Evaluated: " << result << "\n";
+    }
+
+    void flush()
+    {
+        out_.flush();
+    }
+
+private:
+    std::ostream &out_;
+    Verbosity verbosity_;
+};
@@ -0,0 +1,331 @@
+#pragma once
+
+#include "token.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// What a line comes to, once compiled and evaluated
+struct CachedResult
+{
+    double value_ = 0;
+    std::string error_header_; // Empty if the line evaluated to value_
+    std::vector<std::string> diagnostics_;
+};
+
+struct ResultCacheCounters
+{
+    uint64_t hits_ = 0;
+    uint64_t misses_ = 0;
+    uint64_t insertions_ = 0;
+    uint64_t evictions_ = 0;
+    uint64_t entries_ = 0;
+
+    // {"hits": ..., "misses": ..., ...}
+    void write_json(std::ostream &out) const
+    {
+        out << "{\"hits\": " << hits_ << ", \"misses\": " << misses_ << ", \"insertions\": " << insertions_
+            << ", \"evictions\": " << evictions_ << ", \"entries\": " << entries_ << "}";
+    }
+};
+
+// In-memory cache of results, shared by any number of threads.
+//
+// The cache is split in shards, each a fixed-size table of 8-way sets of
+// immutable entries. Lookups take no lock: readers only announce themselves
+// on a per-shard counter while they look at entries. Insertions lock their
+// shard, and evict with the CLOCK algorithm within the set (entries get a
+// second chance if they were hit since the hand last passed). Evicted entries
+// are retired, and only freed once every reader that may still see them is
+// done; retiring in batches keeps writers from waiting on readers too often.
+//
+// Memory is bounded by the number of entries and the size of keys, longer
+// keys aren't cached at all.
+class ResultCache
+{
+public:
+    explicit ResultCache(size_t capacity, size_t max_key_bytes = 4096, size_t shard_count = 16)
+        : max_key_bytes_(max_key_bytes)
+    {
+        // Shards come from the top bits of hashes, sets from the bottom ones
+        shard_count = std::min<size_t>(std::max<size_t>(shard_count, 1), 1 << 16);
+        while (shard_count & (shard_count - 1))
+        {
+            shard_count++;
+        }
+        size_t sets = 1;
+        while (sets * shard_count * ways < capacity)
+        {
+            sets *= 2;
+        }
+        set_mask_ = sets - 1;
+        shards_ = std::make_unique<Shard[]>(shard_count);
+        shard_count_ = shard_count;
+        for (size_t i = 0; i < shard_count; i++)
+        {
+            shards_[i].slots_ = std::make_unique<std::atomic<Entry *>[]>(sets * ways);
+            shards_[i].hands_.resize(sets, 0);
+        }
+    }
+
+    ~ResultCache()
+    {
+        for (size_t i = 0; i < shard_count_; i++)
+        {
+            Shard &shard = shards_[i];
+            for (size_t slot = 0; slot < (set_mask_ + 1) * ways; slot++)
+            {
+                delete shard.slots_[slot].load(std::memory_order_relaxed);
+            }
+            for (Entry *entry : shard.retired_)
+            {
+                delete entry;
+            }
+        }
+    }
+
+    ResultCache(const ResultCache &) = delete;
+    ResultCache &operator=(const ResultCache &) = delete;
+
+    // Normal form of a line for use as a key: its token sequence, without
+    // positions, so lines that only differ in whitespace and comments share
+    // it. Results don't depend on positions, but diagnostics may.
+    static std::string normalize(const std::vector<Token> &tokens)
+    {
+        std::string key;
+        for (const Token &tok : tokens)
+        {
+            if (tok.tag_ == TokenTag::eof)
+            {
+                break;
+            }
+            key += static_cast<char>(static_cast<int>(tok.tag_) + 1);
+            key += tok.val_;
+            key += '\0';
+        }
+        return key;
+    }
+
+    // Key of the exact text of a line, so repeats can be looked up before
+    // lexing. Never the same as a normalized key, which can't start with \0.
+    static std::string raw_key(std::string_view line)
+    {
+        std::string key(1, '\0');
+        key += line;
+        return key;
+    }
+
+    // Copies the result stored for key, if any, into result
+    bool find(const std::string &key, CachedResult &result)
+    {
+        uint64_t hash = std::hash<std::string_view>()(key);
+        Shard &shard = shard_of(hash);
+        bool found = false;
+        {
+            ReadGuard guard(shard);
+            std::atomic<Entry *> *set = set_of(shard, hash);
+            for (size_t way = 0; way < ways; way++)
+            {
+                Entry *entry = set[way].load(std::memory_order_acquire);
+                if (entry && entry->hash_ == hash && entry->key_ == key)
+                {
+                    // Only written when it changes, so hot entries stay shared in caches
+                    if (!entry->referenced_.load(std::memory_order_relaxed))
+                    {
+                        entry->referenced_.store(true, std::memory_order_relaxed);
+                    }
+                    result = entry->result_;
+                    found = true;
+                    break;
+                }
+            }
+        }
+        (found ? shard.hits_ : shard.misses_).fetch_add(1, std::memory_order_relaxed);
+        return found;
+    }
+
+    void insert(const std::string &key, CachedResult result)
+    {
+        if (key.size() > max_key_bytes_)
+        {
+            return;
+        }
+        uint64_t hash = std::hash<std::string_view>()(key);
+        Shard &shard = shard_of(hash);
+        std::lock_guard<std::mutex> lock(shard.mutex_);
+        std::atomic<Entry *> *set = set_of(shard, hash);
+
+        size_t target = ways;
+        for (size_t way = 0; way < ways; way++)
+        {
+            Entry *entry = set[way].load(std::memory_order_relaxed);
+            if (entry && entry->hash_ == hash && entry->key_ == key)
+            {
+                // Another thread got there first
+                return;
+            }
+            if (!entry && target == ways)
+            {
+                target = way;
+            }
+        }
+
+        Entry *victim = nullptr;
+        if (target == ways)
+        {
+            // Set is full: the hand clears reference bits until it finds an
+            // entry that wasn't hit since its last pass
+            uint8_t &hand = shard.hands_[hash & set_mask_];
+            while (true)
+            {
+                Entry *entry = set[hand].load(std::memory_order_relaxed);
+                if (!entry->referenced_.load(std::memory_order_relaxed))
+                {
+                    break;
+                }
+                entry->referenced_.store(false, std::memory_order_relaxed);
+                hand = (hand + 1) % ways;
+            }
+            target = hand;
+            hand = (hand + 1) % ways;
+            victim = set[target].load(std::memory_order_relaxed);
+        }
+
+        set[target].store(new Entry(hash, key, std::move(result)), std::memory_order_release);
+        shard.insertions_++;
+        if (victim)
+        {
+            shard.evictions_++;
+            shard.retired_.push_back(victim);
+            if (shard.retired_.size() >= retire_batch)
+            {
+                synchronize(shard);
+                for (Entry *entry : shard.retired_)
+                {
+                    delete entry;
+                }
+                shard.retired_.clear();
+            }
+        }
+        else
+        {
+            shard.entries_++;
+        }
+    }
+
+    ResultCacheCounters counters() const
+    {
+        ResultCacheCounters total;
+        for (size_t i = 0; i < shard_count_; i++)
+        {
+            Shard &shard = shards_[i];
+            total.hits_ += shard.hits_.load(std::memory_order_relaxed);
+            total.misses_ += shard.misses_.load(std::memory_order_relaxed);
+            std::lock_guard<std::mutex> lock(shard.mutex_);
+            total.insertions_ += shard.insertions_;
+            total.evictions_ += shard.evictions_;
+            total.entries_ += shard.entries_;
+        }
+        return total;
+    }
+
+private:
+    static constexpr size_t ways = 8;
+    static constexpr size_t retire_batch = 64;
+
+    struct Entry
+    {
+        Entry(uint64_t hash, std::string key, CachedResult result)
+            : hash_(hash), key_(std::move(key)), result_(std::move(result)) {}
+
+        const uint64_t hash_;
+        const std::string key_;
+        const CachedResult result_;
+        std::atomic<bool> referenced_{false}; // Hit since the CLOCK hand last passed
+    };
+
+    struct alignas(64) Shard
+    {
+        // Readers announce themselves on the counter of the current epoch's
+        // parity. Writers bump the epoch, then wait for the old parity's
+        // readers to leave (see synchronize()).
+        std::atomic<uint64_t> epoch_{0};
+        std::atomic<uint64_t> readers_[2] = {};
+        std::atomic<uint64_t> hits_{0};
+        std::atomic<uint64_t> misses_{0};
+
+        std::unique_ptr<std::atomic<Entry *>[]> slots_;
+
+        // Writers only
+        mutable std::mutex mutex_;
+        std::vector<uint8_t> hands_; // CLOCK hand of each set
+        std::vector<Entry *> retired_;
+        uint64_t insertions_ = 0;
+        uint64_t evictions_ = 0;
+        uint64_t entries_ = 0;
+    };
+
+    class ReadGuard
+    {
+    public:
+        explicit ReadGuard(Shard &shard) : shard_(shard)
+        {
+            while (true)
+            {
+                parity_ = shard_.epoch_.load(std::memory_order_seq_cst) & 1;
+                shard_.readers_[parity_].fetch_add(1, std::memory_order_seq_cst);
+                // If a writer flipped the epoch meanwhile, it may not wait for us
+                if ((shard_.epoch_.load(std::memory_order_seq_cst) & 1) == parity_)
+                {
+                    return;
+                }
+                shard_.readers_[parity_].fetch_sub(1, std::memory_order_release);
+            }
+        }
+
+        ~ReadGuard()
+        {
+            shard_.readers_[parity_].fetch_sub(1, std::memory_order_release);
+        }
+
+    private:
+        Shard &shard_;
+        uint64_t parity_;
+    };
+
+    // Waits until no reader can still see entries unlinked before the call.
+    // Readers that come later announce themselves on the other counter, so
+    // this never waits on more than the readers already in.
+    static void synchronize(Shard &shard)
+    {
+        uint64_t parity = shard.epoch_.fetch_add(1, std::memory_order_seq_cst) & 1;
+        while (shard.readers_[parity].load(std::memory_order_seq_cst) != 0)
+        {
+            std::this_thread::yield();
+        }
+    }
+
+    Shard &shard_of(uint64_t hash) const
+    {
+        return shards_[(hash >> 48) & (shard_count_ - 1)];
+    }
+
+    std::atomic<Entry *> *set_of(Shard &shard, uint64_t hash) const
+    {
+        return &shard.slots_[(hash & set_mask_) * ways];
+    }
+
+    size_t max_key_bytes_;
+    size_t set_mask_;
+    size_t shard_count_;
+    std::unique_ptr<Shard[]> shards_;
+};
@@ -0,0 +1,668 @@
+#include <algorithm>
+#include <bitset>
+#include <cctype>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+
+// Build-time scanner generator: turns the rules of a token specification
+// (see tokens.spec) into the tables of one minimized DFA, as a C++ header
+// for GeneratedLexer.
+//
+// Each rule's regex becomes a Thompson NFA. The subset construction builds a
+// DFA from the start state of every section at once, where each state
+// accepts the first rule listed among those it matches. Moore's algorithm
+// then merges states that accept the same rule and go to merged states on
+// every byte. Bytes that no regex tells apart share a column of the table.
+
+namespace
+{
+    using ByteSet = std::bitset<256>;
+
+    struct Rule
+    {
+        std::string section_;
+        std::string action_; // Or the TokenTag, for tokens
+        bool token_ = false;
+        bool at_last_ = false;
+        int line_ = 0;
+    };
+
+    // Thompson NFA, built a fragment at a time
+
+    struct NfaState
+    {
+        enum Kind
+        {
+            set,   // Consumes a byte of sets_[set_], then goes to out_
+            split, // Goes to out_ and out1_
+            empty, // Goes to out_
+            accept
+        } kind_;
+        int set_ = 0;
+        int out_ = -1;
+        int out1_ = -1;
+        int rule_ = -1; // For accept
+    };
+
+    struct Nfa
+    {
+        std::vector<NfaState> states_;
+        std::vector<ByteSet> sets_;
+
+        int add(NfaState state)
+        {
+            states_.push_back(state);
+            return static_cast<int>(states_.size()) - 1;
+        }
+    };
+
+    // Part of the NFA with one entry, and exits still to connect. An exit is
+    // a state, times 2, plus 1 for its out1_.
+    struct Fragment
+    {
+        int start_;
+        std::vector<int> exits_;
+    };
+
+    // Recursive descent over one rule's regex:
+    //     alternation := concat ('|' concat)*
+    //     concat      := repeat*
+    //     repeat      := atom ('*' | '+' | '?')*
+    //     atom        := '(' alternation ')' | '[' class ']' | '.' | escape | byte
+    class RegexCompiler
+    {
+    public:
+        RegexCompiler(const std::string &regex, Nfa &nfa) : regex_(regex), nfa_(nfa) {}
+
+        // Returns the first state, with the regex's exits going to accept
+        int compile(int accept)
+        {
+            Fragment f = alternation();
+            if (pos_ < regex_.size())
+            {
+                throw std::string("unmatched )");
+            }
+            connect(f, accept);
+            return f.start_;
+        }
+
+    private:
+        bool more() const
+        {
+            return pos_ < regex_.size() && regex_[pos_] != '|' && regex_[pos_] != ')';
+        }
+
+        void connect(const Fragment &f, int state)
+        {
+            for (int exit : f.exits_)
+            {
+                NfaState &s = nfa_.states_[exit >> 1];
+                (exit & 1 ? s.out1_ : s.out_) = state;
+            }
+        }
+
+        Fragment alternation()
+        {
+            Fragment f = concat();
+            while (pos_ < regex_.size() && regex_[pos_] == '|')
+            {
+                pos_++;
+                Fragment g = concat();
+                int split = nfa_.add(NfaState{NfaState::split, 0, f.start_, g.start_});
+                f.exits_.insert(f.exits_.end(), g.exits_.begin(), g.exits_.end());
+                f.start_ = split;
+            }
+            return f;
+        }
+
+        Fragment concat()
+        {
+            if (!more())
+            {
+                int empty = nfa_.add(NfaState{NfaState::empty});
+                return Fragment{empty, {empty << 1}};
+            }
+            Fragment f = repeat();
+            while (more())
+            {
+                Fragment g = repeat();
+                connect(f, g.start_);
+                f.exits_ = std::move(g.exits_);
+            }
+            return f;
+        }
+
+        Fragment repeat()
+        {
+            Fragment f = atom();
+            while (pos_ < regex_.size() && (regex_[pos_] == '*' || regex_[pos_] == '+' || regex_[pos_] == '?'))
+            {
+                char op = regex_[pos_++];
+                int split = nfa_.add(NfaState{NfaState::split, 0, f.start_});
+                if (op == '?')
+                {
+                    f.exits_.push_back(split << 1 | 1);
+                    f.start_ = split;
+                    continue;
+                }
+                connect(f, split);
+                f.exits_ = {split << 1 | 1};
+                if (op == '*')
+                {
+                    f.start_ = split;
+                }
+            }
+            return f;
+        }
+
+        Fragment atom()
+        {
+            char c = regex_[pos_++];
+            ByteSet set;
+            switch (c)
+            {
+            case '(':
+            {
+                Fragment f = alternation();
+                if (pos_ >= regex_.size() || regex_[pos_] != ')')
+                {
+                    throw std::string("unmatched (");
+                }
+                pos_++;
+                return f;
+            }
+            case '*':
+            case '+':
+            case '?':
+                throw std::string("nothing to repeat");
+            case '[':
+                set = byte_class();
+                break;
+            case '.':
+                set.set();
+                set.reset('\n');
+                break;
+            case '\\':
+                set = escape();
+                break;
+            default:
+                set.set(static_cast<unsigned char>(c));
+            }
+            // Lines end at '\0'
+            set.reset(0);
+            nfa_.sets_.push_back(set);
+            int state = nfa_.add(NfaState{NfaState::set, static_cast<int>(nfa_.sets_.size()) - 1});
+            return Fragment{state, {state << 1}};
+        }
+
+        // After a '\'
+        ByteSet escape()
+        {
+            if (pos_ >= regex_.size())
+            {
+                throw std::string("trailing \\");
+            }
+            char c = regex_[pos_++];
+            ByteSet set;
+            switch (c)
+            {
+            case 'n':
+                set.set('\n');
+                break;
+            case 't':
+                set.set('\t');
+                break;
+            case 'r':
+                set.set('\r');
+                break;
+            case 'd':
+                for (int b = '0'; b <= '9'; b++)
+                    set.set(b);
+                break;
+            case 's':
+                for (char b : {' ', '\t', '\n', '\r', '\f', '\v'})
+                    set.set(static_cast<unsigned char>(b));
+                break;
+            default:
+                if (std::isalnum(static_cast<unsigned char>(c)))
+                {
+                    throw std::string("unknown escape \\") + c;
+                }
+                set.set(static_cast<unsigned char>(c));
+            }
+            return set;
+        }
+
+        // After a '[', up to and including the ']'
+        ByteSet byte_class()
+        {
+            ByteSet set;
+            bool negated = pos_ < regex_.size() && regex_[pos_] == '^';
+            if (negated)
+            {
+                pos_++;
+            }
+            while (true)
+            {
+                if (pos_ >= regex_.size())
+                {
+                    throw std::string("unmatched [");
+                }
+                char c = regex_[pos_++];
+                if (c == ']')
+                {
+                    break;
+                }
+                if (c == '\\')
+                {
+                    ByteSet escaped = escape();
+                    if (escaped.count() != 1)
+                    {
+                        set |= escaped;
+                        continue;
+                    }
+                    c = static_cast<char>(first_byte(escaped));
+                }
+                if (pos_ + 1 < regex_.size() && regex_[pos_] == '-' && regex_[pos_ + 1] != ']')
+                {
+                    unsigned char hi = static_cast<unsigned char>(regex_[pos_ + 1]);
+                    pos_ += 2;
+                    if (hi < static_cast<unsigned char>(c))
+                    {
+                        throw std::string("bad range in class");
+                    }
+                    for (int b = static_cast<unsigned char>(c); b <= hi; b++)
+                    {
+                        set.set(b);
+                    }
+                }
+                else
+                {
+                    set.set(static_cast<unsigned char>(c));
+                }
+            }
+            return negated ? ~set : set;
+        }
+
+        static int first_byte(const ByteSet &set)
+        {
+            for (int b = 0; b < 256; b++)
+                if (set.test(b))
+                    return b;
+            return 0;
+        }
+
+        const std::string &regex_;
+        size_t pos_ = 0;
+        Nfa &nfa_;
+    };
+
+    // DFA, built from the NFA and then minimized
+
+    struct Dfa
+    {
+        int classes_ = 0;
+        unsigned char byte_class_[256];
+        std::vector<std::vector<int>> next_; // Per state and class
+        std::vector<int> accept_;            // Rule per state, or -1
+        std::map<std::string, int> starts_;  // Per section
+    };
+
+    // Bytes in the same sets share a class. Class 0 is the bytes in none
+    // (like '\0'), which always lead to the dead state.
+    void build_classes(const Nfa &nfa, Dfa &dfa)
+    {
+        std::map<std::vector<bool>, int> classes;
+        classes[std::vector<bool>(nfa.sets_.size(), false)] = 0;
+        for (int b = 0; b < 256; b++)
+        {
+            std::vector<bool> signature;
+            for (const ByteSet &set : nfa.sets_)
+            {
+                signature.push_back(set.test(b));
+            }
+            auto it = classes.emplace(signature, static_cast<int>(classes.size())).first;
+            dfa.byte_class_[b] = static_cast<unsigned char>(it->second);
+        }
+        dfa.classes_ = static_cast<int>(classes.size());
+    }
+
+    // Adds the states reachable from state without consuming input to set
+    void closure(const Nfa &nfa, int state, std::vector<bool> &set)
+    {
+        std::vector<int> stack{state};
+        while (!stack.empty())
+        {
+            int s = stack.back();
+            stack.pop_back();
+            if (s < 0 || set[s])
+            {
+                continue;
+            }
+            set[s] = true;
+            const NfaState &n = nfa.states_[s];
+            if (n.kind_ == NfaState::split || n.kind_ == NfaState::empty)
+            {
+                stack.push_back(n.out_);
+                stack.push_back(n.out1_);
+            }
+        }
+    }
+
+    Dfa subset_construction(const Nfa &nfa, const std::map<std::string, std::vector<int>> &section_starts)
+    {
+        Dfa dfa;
+        build_classes(nfa, dfa);
+
+        // A byte of each class
+        std::vector<int> class_byte(dfa.classes_, 0);
+        for (int b = 255; b >= 0; b--)
+        {
+            class_byte[dfa.byte_class_[b]] = b;
+        }
+
+        std::map<std::vector<bool>, int> ids;
+        std::vector<std::vector<bool>> sets;
+        auto state_id = [&](const std::vector<bool> &set)
+        {
+            auto it = ids.find(set);
+            if (it != ids.end())
+            {
+                return it->second;
+            }
+            int id = static_cast<int>(sets.size());
+            ids.emplace(set, id);
+            sets.push_back(set);
+            int accept = -1;
+            for (size_t s = 0; s < set.size(); s++)
+            {
+                if (set[s] && nfa.states_[s].kind_ == NfaState::accept &&
+                    (accept < 0 || nfa.states_[s].rule_ < accept))
+                {
+                    accept = nfa.states_[s].rule_;
+                }
+            }
+            dfa.accept_.push_back(accept);
+            return id;
+        };
+
+        state_id(std::vector<bool>(nfa.states_.size(), false)); // dead
+        for (const auto &section : section_starts)
+        {
+            std::vector<bool> set(nfa.states_.size(), false);
+            for (int start : section.second)
+            {
+                closure(nfa, start, set);
+            }
+            dfa.starts_[section.first] = state_id(set);
+        }
+
+        for (size_t id = 0; id < sets.size(); id++)
+        {
+            std::vector<int> row(dfa.classes_, 0);
+            for (int c = 1; c < dfa.classes_; c++)
+            {
+                std::vector<bool> next(nfa.states_.size(), false);
+                for (size_t s = 0; s < nfa.states_.size(); s++)
+                {
+                    const NfaState &n = nfa.states_[s];
+                    if (sets[id][s] && n.kind_ == NfaState::set && nfa.sets_[n.set_].test(class_byte[c]))
+                    {
+                        closure(nfa, n.out_, next);
+                    }
+                }
+                row[c] = state_id(next);
+            }
+            dfa.next_.push_back(row);
+        }
+        return dfa;
+    }
+
+    // Moore's algorithm: start from states grouped by the rule they accept,
+    // and split groups until all states of each group go to the same groups
+    Dfa minimize(const Dfa &dfa)
+    {
+        size_t n = dfa.next_.size();
+        std::vector<int> group(n);
+        size_t groups = 0;
+        while (true)
+        {
+            std::map<std::vector<int>, int> signatures;
+            std::vector<int> next_group(n);
+            for (size_t s = 0; s < n; s++)
+            {
+                std::vector<int> signature{dfa.accept_[s], groups ? group[s] : 0};
+                for (int to : dfa.next_[s])
+                {
+                    signature.push_back(groups ? group[to] : 0);
+                }
+                next_group[s] = signatures.emplace(signature, static_cast<int>(signatures.size())).first->second;
+            }
+            group = std::move(next_group);
+            if (signatures.size() == groups)
+            {
+                break;
+            }
+            groups = signatures.size();
+        }
+
+        // Renumber, keeping the dead state first and states in order
+        std::vector<int> id(groups, -1);
+        std::vector<int> representative;
+        for (size_t s = 0; s < n; s++)
+        {
+            if (id[group[s]] < 0)
+            {
+                id[group[s]] = static_cast<int>(representative.size());
+                representative.push_back(static_cast<int>(s));
+            }
+        }
+
+        Dfa min;
+        min.classes_ = dfa.classes_;
+        std::copy(dfa.byte_class_, dfa.byte_class_ + 256, min.byte_class_);
+        for (int s : representative)
+        {
+            std::vector<int> row;
+            for (int to : dfa.next_[s])
+            {
+                row.push_back(id[group[to]]);
+            }
+            min.next_.push_back(row);
+            min.accept_.push_back(dfa.accept_[s]);
+        }
+        for (const auto &start : dfa.starts_)
+        {
+            min.starts_[start.first] = id[group[start.second]];
+        }
+        return min;
+    }
+
+    template <typename T>
+    void write_array(std::ostream &out, const std::string &declaration, const std::vector<T> &values)
+    {
+        out << "    static constexpr " << declaration << " = {";
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            out << (i % 16 == 0 ? "\n        " : " ") << +values[i] << (i + 1 < values.size() ? "," : "");
+        }
+        out << "\n    };\n";
+    }
+
+    void write_header(std::ostream &out, const std::string &spec, const Dfa &dfa, const std::vector<Rule> &rules)
+    {
+        std::vector<std::string> actions;
+        for (const Rule &rule : rules)
+        {
+            if (!rule.token_ && std::find(actions.begin(), actions.end(), rule.action_) == actions.end())
+            {
+                actions.push_back(rule.action_);
+            }
+        }
+        actions.push_back("token");
+
+        out << "// Generated by scanner_generator from " << spec << ": edit that instead.\n"
+            << "#pragma once\n\n"
+            << "#include \"token.hpp\"\n\n"
+            << "#include <cstdint>\n\n"
+            << "// Minimized DFA of every rule, for GeneratedLexer. State 0 is dead.\n"
+            << "struct ScannerTables\n{\n"
+            << "    enum class Action : uint8_t\n    {\n";
+        for (size_t i = 0; i < actions.size(); i++)
+        {
+            out << "        " << actions[i] << (i + 1 < actions.size() ? ",\n" : "\n");
+        }
+        out << "    };\n\n"
+            << "    struct Rule\n    {\n"
+            << "        Action action_;\n"
+            << "        TokenTag tag_;  // For tokens\n"
+            << "        bool at_last_;  // Token position is its last byte, not one past it\n"
+            << "    };\n\n"
+            << "    static constexpr int dead = 0;\n";
+        for (const auto &start : dfa.starts_)
+        {
+            out << "    static constexpr int start_" << start.first << " = " << start.second << ";\n";
+        }
+        out << "    static constexpr int classes = " << dfa.classes_ << ";\n"
+            << "    static constexpr int states = " << dfa.next_.size() << ";\n\n";
+
+        std::vector<int> byte_class(dfa.byte_class_, dfa.byte_class_ + 256);
+        write_array(out, "uint8_t byte_class[256]", byte_class);
+        std::vector<int> next;
+        for (const auto &row : dfa.next_)
+        {
+            next.insert(next.end(), row.begin(), row.end());
+        }
+        write_array(out, std::string(dfa.next_.size() <= 256 ? "uint8_t" : "uint16_t") + " next[states * classes]",
+                    next);
+        write_array(out, "int8_t accept[states]", dfa.accept_);
+
+        out << "    static constexpr Rule rules[] = {\n";
+        for (const Rule &rule : rules)
+        {
+            out << "        {Action::" << (rule.token_ ? "token" : rule.action_) << ", TokenTag::"
+                << (rule.token_ ? rule.action_ : "bad") << ", " << (rule.at_last_ ? "true" : "false") << "}, // "
+                << spec << ":" << rule.line_ << "\n";
+        }
+        out << "    };\n};\n";
+    }
+
+    std::string trim(const std::string &s)
+    {
+        size_t begin = s.find_first_not_of(" \t\r");
+        size_t end = s.find_last_not_of(" \t\r");
+        return begin == std::string::npos ? "" : s.substr(begin, end - begin + 1);
+    }
+}
+
+// Usage: scanner_generator <spec> <output header>
+int main(int argc, char *argv[])
+{
+    if (argc != 3)
+    {
+        std::cout << "Usage: " << argv[0] << " <spec> <output header>" << std::endl;
+        return -1;
+    }
+    std::string spec_path = argv[1];
+    std::string spec_name = spec_path.substr(spec_path.find_last_of("/\\") + 1);
+    std::ifstream spec(spec_path);
+    if (!spec)
+    {
+        std::cout << "Can't open " << spec_path << std::endl;
+        return -1;
+    }
+
+    Nfa nfa;
+    std::vector<Rule> rules;
+    std::map<std::string, std::vector<int>> section_starts;
+    std::string section;
+    std::string line;
+    for (int number = 1; std::getline(spec, line); number++)
+    {
+        try
+        {
+            line = trim(line);
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+            if (line.front() == '[' && line.back() == ']')
+            {
+                section = line.substr(1, line.size() - 2);
+                continue;
+            }
+            if (section.empty())
+            {
+                throw std::string("rule outside of a [section]");
+            }
+
+            Rule rule;
+            rule.section_ = section;
+            rule.line_ = number;
+            rule.token_ = section == "token";
+            std::istringstream columns(line);
+            columns >> rule.action_;
+            if (rule.token_)
+            {
+                std::string position;
+                columns >> position;
+                if (position != "end" && position != "last")
+                {
+                    throw std::string("token position must be end or last");
+                }
+                rule.at_last_ = position == "last";
+            }
+            std::string regex;
+            std::getline(columns, regex);
+            regex = trim(regex);
+            if (regex.empty())
+            {
+                throw std::string("missing regex");
+            }
+
+            int accept = nfa.add(NfaState{NfaState::accept});
+            nfa.states_[accept].rule_ = static_cast<int>(rules.size());
+            section_starts[section].push_back(RegexCompiler(regex, nfa).compile(accept));
+            rules.push_back(rule);
+        }
+        catch (const std::string &error)
+        {
+            std::cout << spec_path << ":" << number << ": " << error << std::endl;
+            return -1;
+        }
+    }
+    if (rules.size() > 127)
+    {
+        std::cout << spec_path << ": too many rules" << std::endl;
+        return -1;
+    }
+
+    Dfa dfa = minimize(subset_construction(nfa, section_starts));
+    for (const auto &start : dfa.starts_)
+    {
+        // Rules that match nothing would loop forever in the lexer
+        if (dfa.accept_[start.second] >= 0)
+        {
+            std::cout << spec_path << ":" << rules[dfa.accept_[start.second]].line_
+                      << ": rule matches the empty string" << std::endl;
+            return -1;
+        }
+    }
+
+    std::ostringstream header;
+    write_header(header, spec_name, dfa, rules);
+    std::ofstream out(argv[2], std::ios::binary);
+    out << header.str();
+    if (!out)
+    {
+        std::cout << "Can't write " << argv[2] << std::endl;
+        return -1;
+    }
+    std::cout << spec_name << ": " << rules.size() << " rules, " << dfa.next_.size() << " states, " << dfa.classes_
+              << " byte classes" << std::endl;
+    return 0;
+}
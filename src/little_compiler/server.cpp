@@ -0,0 +1,331 @@
+/*
+Expression evaluation daemon.
+
+Listens on a Unix domain socket, and evaluates the expressions of each request
+on a pool of worker threads (see protocol.hpp for the wire format).
+Results are kept in memory, so repeated expressions are answered without
+compiling or evaluating them again. SIGINT/SIGTERM stop accepting new connections, finish every request
+already received, and then exit.
+
+Usage: little_server <socket path> [--workers=N] [--queue=N] [--cache=N]
+                     [--max-tokens=N] [--max-depth=N] [--max-nodes=N] [--max-steps=N] [--deadline-us=N]
+
+The budget flags limit the work spent on each expression, so that a single
+pathological line fails with a "Budget error:" instead of holding up a worker.
+ */
+
+#include "little_compiler.hpp"
+#include "protocol.hpp"
+#include "result_cache.hpp"
+#include "thread_pool.hpp"
+
+#include <poll.h>
+#include <signal.h>
+
+#include <algorithm>
+#include <condition_variable>
+#include <csignal>
+#include <deque>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// Set by the signal handler, polled by the accept loop
+volatile std::sig_atomic_t shutdown_requested = 0;
+
+void handle_signal(int)
+{
+    shutdown_requested = 1;
+}
+
+class Server
+{
+public:
+    Server(size_t workers, size_t max_queued, size_t cache_capacity, const Budget &budget)
+        : contexts_(workers), cache_(cache_capacity), pool_(workers, max_queued)
+    {
+        for (auto &context : contexts_)
+        {
+            context.set_budget(budget);
+        }
+    }
+
+    ResultCacheCounters cache_counters() const
+    {
+        return cache_.counters();
+    }
+
+    // Accepts connections until shutdown is requested, then waits for every
+    // connection to finish its pending requests.
+    void serve(int listen_fd)
+    {
+        while (!shutdown_requested)
+        {
+            pollfd pfd{listen_fd, POLLIN, 0};
+            if (::poll(&pfd, 1, 200) <= 0)
+            {
+                continue;
+            }
+            int fd = ::accept(listen_fd, nullptr, nullptr);
+            if (fd < 0)
+            {
+                continue;
+            }
+
+            std::lock_guard<std::mutex> lock(open_mutex_);
+            open_fds_.push_back(fd);
+            std::thread([this, fd]()
+                        { handle_connection(fd); })
+                .detach();
+        }
+
+        // Stop reading new requests, already received ones still get answered
+        std::unique_lock<std::mutex> lock(open_mutex_);
+        for (int fd : open_fds_)
+        {
+            ::shutdown(fd, SHUT_RD);
+        }
+        all_closed_.wait(lock, [this]()
+                         { return open_fds_.empty(); });
+    }
+
+private:
+    // Expressions of one request are split in batches of this size, so that a
+    // single large request is spread over all workers
+    static constexpr size_t batch_size = 64;
+
+    // Requests of a single connection that may be in flight at once.
+    // Past this, we stop reading from the socket until responses are sent.
+    static constexpr size_t max_pending = 16;
+
+    using Request = std::vector<std::future<std::string>>;
+
+    struct Connection
+    {
+        std::mutex mutex_;
+        std::condition_variable changed_;
+        std::deque<Request> pending_;
+        bool done_reading_ = false;
+    };
+
+    void handle_connection(int fd)
+    {
+        Connection connection;
+        std::thread writer([this, fd, &connection]()
+                           { write_responses(fd, connection); });
+
+        std::string payload;
+        while (protocol::read_frame(fd, payload))
+        {
+            Request request = submit(payload);
+
+            std::unique_lock<std::mutex> lock(connection.mutex_);
+            connection.changed_.wait(lock, [&connection]()
+                                     { return connection.pending_.size() < max_pending; });
+            connection.pending_.push_back(std::move(request));
+            connection.changed_.notify_all();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock(connection.mutex_);
+            connection.done_reading_ = true;
+        }
+        connection.changed_.notify_all();
+        writer.join();
+
+        // Notify while holding the lock: once it's released, this thread no
+        // longer touches the server, which may then be destroyed
+        std::lock_guard<std::mutex> lock(open_mutex_);
+        open_fds_.erase(std::find(open_fds_.begin(), open_fds_.end(), fd));
+        ::close(fd);
+        all_closed_.notify_all();
+    }
+
+    // Sends responses back in request order, as they complete
+    void write_responses(int fd, Connection &connection)
+    {
+        bool connected = true;
+        while (true)
+        {
+            Request request;
+            {
+                std::unique_lock<std::mutex> lock(connection.mutex_);
+                connection.changed_.wait(lock, [&connection]()
+                                         { return connection.done_reading_ || !connection.pending_.empty(); });
+                if (connection.pending_.empty())
+                {
+                    return;
+                }
+                request = std::move(connection.pending_.front());
+                connection.pending_.pop_front();
+            }
+            connection.changed_.notify_all();
+
+            std::string response;
+            for (auto &batch : request)
+            {
+                response += batch.get();
+            }
+            // Keep draining after the peer goes away, so the reader never blocks
+            connected = connected && protocol::write_frame(fd, response);
+        }
+    }
+
+    Request submit(const std::string &payload)
+    {
+        auto lines = std::make_shared<std::vector<std::string>>();
+        std::string_view rest = payload;
+        while (!rest.empty())
+        {
+            size_t end = rest.find('\n');
+            lines->emplace_back(rest.substr(0, end));
+            rest = end == std::string_view::npos ? std::string_view() : rest.substr(end + 1);
+        }
+
+        Request request;
+        for (size_t begin = 0; begin < lines->size(); begin += batch_size)
+        {
+            size_t end = std::min(begin + batch_size, lines->size());
+            auto result = std::make_shared<std::promise<std::string>>();
+            request.push_back(result->get_future());
+            pool_.submit([this, lines, begin, end, result](size_t worker)
+                         { result->set_value(process(*lines, begin, end, worker)); });
+        }
+        return request;
+    }
+
+    std::string process(const std::vector<std::string> &lines, size_t begin, size_t end, size_t worker)
+    {
+        little::Context &context = contexts_[worker];
+        std::stringstream out;
+        for (size_t i = begin; i < end; i++)
+        {
+            // Diagnostics mention columns, so results are keyed by the exact text
+            std::string key = ResultCache::raw_key(lines[i]);
+            CachedResult result;
+            if (!cache_.find(key, result))
+            {
+                auto expr = context.compile(lines[i]);
+                if (expr->empty())
+                {
+                    out << "empty\n";
+                    continue;
+                }
+                if (!expr->ok())
+                {
+                    result = CachedResult{0, expr->error_header(), expr->diagnostics()};
+                }
+                else
+                {
+                    try
+                    {
+                        result.value_ = context.evaluate(*expr);
+                    }
+                    catch (const BudgetExceeded &e)
+                    {
+                        result = CachedResult{0, "Budget error:", {e.what()}};
+                    }
+                    catch (const std::exception &e)
+                    {
+                        result = CachedResult{0, "Evaluator error:", {std::string("Error: ") + e.what()}};
+                    }
+                }
+                // Budget errors depend on timing, so the line gets another chance next time
+                if (result.error_header_ != "Budget error:")
+                {
+                    cache_.insert(key, result);
+                }
+            }
+
+            if (result.error_header_.empty())
+            {
+                out << "ok\t" << result.value_ << "\n";
+            }
+            else
+            {
+                out << "error\t" << result.error_header_;
+                for (auto &msg : result.diagnostics_)
+                {
+                    out << "\t" << msg;
+                }
+                out << "\n";
+            }
+        }
+        return out.str();
+    }
+
+    std::vector<little::Context> contexts_; // One per worker
+    ResultCache cache_; // Shared between all workers and connections
+
+    std::mutex open_mutex_;
+    std::condition_variable all_closed_;
+    std::vector<int> open_fds_; // Sockets of connections being served
+
+    // Declared last, so its workers are joined before anything they use is destroyed
+    ThreadPool pool_;
+};
+
+int main(int argc, char *argv[])
+{
+    std::string socket_path;
+    size_t workers = std::max(1u, std::thread::hardware_concurrency());
+    size_t queue = 1024;
+    size_t cache = 1 << 16;
+    Budget budget;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        if (arg.rfind("--workers=", 0) == 0)
+            workers = std::max(1ul, std::stoul(arg.substr(10)));
+        else if (arg.rfind("--queue=", 0) == 0)
+            queue = std::max(1ul, std::stoul(arg.substr(8)));
+        else if (arg.rfind("--cache=", 0) == 0)
+            cache = std::max(1ul, std::stoul(arg.substr(8)));
+        else if (parse_budget_flag(arg, budget))
+            continue;
+        else
+            socket_path = arg;
+    }
+
+    if (socket_path.empty())
+    {
+        std::cout << "Usage: " << argv[0] << " <socket path> [--workers=N] [--queue=N] [--cache=N]"
+                  << " [--max-tokens=N] [--max-depth=N] [--max-nodes=N] [--max-steps=N] [--deadline-us=N]" << std::endl;
+        return -1;
+    }
+
+    struct sigaction action = {};
+    action.sa_handler = handle_signal;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, nullptr);
+    sigaction(SIGTERM, &action, nullptr);
+
+    int listen_fd = protocol::listen_on(socket_path, 64);
+    if (listen_fd < 0)
+    {
+        std::cout << "Can't listen on " << socket_path << ": " << std::strerror(errno) << std::endl;
+        return -1;
+    }
+    std::cout << "Listening on " << socket_path << " with " << workers << " workers" << std::endl;
+
+    ResultCacheCounters counters;
+    {
+        Server server(workers, queue, cache, budget);
+        server.serve(listen_fd);
+        counters = server.cache_counters();
+    }
+
+    ::close(listen_fd);
+    ::unlink(socket_path.c_str());
+    std::cout << "Result cache: ";
+    counters.write_json(std::cout);
+    std::cout << "\nShut down" << std::endl;
+    return 0;
+}
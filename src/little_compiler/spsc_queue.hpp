@@ -0,0 +1,116 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+
+// Bounded lock-free queue, for exactly one producer thread and one consumer
+// thread. Capacity must be a power of two. Only a blocking push or pop that
+// has to wait for long takes a lock, to sleep.
+template <typename T, size_t Capacity>
+class SpscQueue
+{
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    // Moves value into the queue, unless it's full
+    bool try_push(T &value)
+    {
+        size_t tail = tail_.load(std::memory_order_relaxed);
+        if (tail - head_.load(std::memory_order_acquire) == Capacity)
+        {
+            return false;
+        }
+        slots_[tail & (Capacity - 1)] = std::move(value);
+        tail_.store(tail + 1, std::memory_order_release);
+        wake();
+        return true;
+    }
+
+    // Moves the oldest element into value, unless the queue is empty
+    bool try_pop(T &value)
+    {
+        size_t head = head_.load(std::memory_order_relaxed);
+        if (head == tail_.load(std::memory_order_acquire))
+        {
+            return false;
+        }
+        value = std::move(slots_[head & (Capacity - 1)]);
+        head_.store(head + 1, std::memory_order_release);
+        wake();
+        return true;
+    }
+
+    // Blocking versions: the other side usually catches up soon, so they
+    // yield for a while before sleeping on a condition variable
+    void push(T value)
+    {
+        for (int spins = 0; !try_push(value); spins++)
+        {
+            if (spins < max_spins)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                sleep_until([this]
+                            { return tail_.load(std::memory_order_relaxed) - head_.load(std::memory_order_acquire) != Capacity; });
+            }
+        }
+    }
+
+    T pop()
+    {
+        T value;
+        for (int spins = 0; !try_pop(value); spins++)
+        {
+            if (spins < max_spins)
+            {
+                std::this_thread::yield();
+            }
+            else
+            {
+                sleep_until([this]
+                            { return head_.load(std::memory_order_relaxed) != tail_.load(std::memory_order_acquire); });
+            }
+        }
+        return value;
+    }
+
+private:
+    static constexpr int max_spins = 64;
+
+    // A sleeper announces itself before checking ready, and the other side
+    // announces its push or pop before checking for sleepers, so one of
+    // them always sees the other
+    template <typename Ready>
+    void sleep_until(Ready ready)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        sleepers_.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        ready_.wait(lock, ready);
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers_.load(std::memory_order_relaxed) > 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            ready_.notify_all();
+        }
+    }
+
+    // Producer and consumer indices live on separate cache lines
+    alignas(64) std::atomic<size_t> head_{0}; // Next slot to pop
+    alignas(64) std::atomic<size_t> tail_{0}; // Next slot to push
+    alignas(64) std::array<T, Capacity> slots_;
+    std::atomic<int> sleepers_{0}; // Threads in sleep_until
+    std::mutex mutex_;
+    std::condition_variable ready_;
+};
@@ -0,0 +1,361 @@
+#pragma once
+
+// Per-phase timing and throughput counters.
+//
+// Build with LITTLE_COMPILER_STATS=0 to compile every timer and counter down
+// to nothing. When compiled in, a null Stats pointer disables collection at
+// runtime, at the cost of a single branch per phase.
+
+#ifndef LITTLE_COMPILER_STATS
+#define LITTLE_COMPILER_STATS 1
+#endif
+
+#include "phase.hpp"
+#include "alloc_tracker.hpp"
+#include "latency_histogram.hpp"
+#include "perf_counters.hpp"
+#include "result_cache.hpp"
+
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <ctime>
+#include <ostream>
+
+#ifndef _WIN32
+#include <sys/resource.h>
+#endif
+
+struct PhaseStats
+{
+    uint64_t calls_ = 0; // For compilation phases, one call per line
+    uint64_t tokens_ = 0;
+    uint64_t nodes_ = 0;
+    uint64_t diagnostics_ = 0;
+    uint64_t wall_ns_ = 0;
+    uint64_t cpu_ns_ = 0; // CPU time of the thread running the phase
+    PerfSample perf_;     // With perf counters enabled
+
+    LatencyHistogram latency_; // Time spent in the phase by each line that went through it
+    uint64_t line_ns_ = 0;     // So far, on the current line
+    bool line_active_ = false;
+};
+
+// Set by a signal handler (ie on SIGUSR1) to ask for a latency report in the
+// middle of a run. Drivers poll it between lines, see report_latency_if_requested().
+inline volatile std::sig_atomic_t latency_report_requested = 0;
+
+// Counters of a single run. Each phase must only be updated by one thread at
+// a time (ie one Stats per driver, with one thread per phase at most).
+class Stats
+{
+public:
+    PhaseStats &operator[](Phase phase)
+    {
+        return phases_[static_cast<int>(phase)];
+    }
+
+    const PhaseStats &operator[](Phase phase) const
+    {
+        return phases_[static_cast<int>(phase)];
+    }
+
+    // Nanoseconds of CPU time used by the calling thread
+    static uint64_t thread_cpu_ns()
+    {
+#ifdef _WIN32
+        return static_cast<uint64_t>(std::clock()) * (1000000000 / CLOCKS_PER_SEC);
+#else
+        timespec ts;
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+        return static_cast<uint64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+#endif
+    }
+
+    // Peak resident set size of the process, in KiB (0 if unknown)
+    static uint64_t peak_rss_kb()
+    {
+#ifdef _WIN32
+        return 0;
+#else
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return static_cast<uint64_t>(usage.ru_maxrss);
+#endif
+    }
+
+    // Counts hardware events per phase too (or whatever PerfCounters falls
+    // back to), at the cost of a few syscalls per phase
+    void enable_perf_counters()
+    {
+        perf_ = true;
+    }
+
+    bool perf_counters_enabled() const
+    {
+        return perf_;
+    }
+
+    // Keeps the n slowest lines, instead of the default 10
+    void set_slowest_lines(size_t n)
+    {
+        slowest_ = SlowestLines(n);
+    }
+
+    // Reports the counters of a result cache along with the rest
+    void set_result_cache(const ResultCache *cache)
+    {
+        result_cache_ = cache;
+    }
+
+    // Closes the current line for one phase: the time the line spent in it
+    // goes to the phase's histogram, if it went through the phase at all.
+    // Must be called from the thread running the phase.
+    void end_line_phase(Phase phase)
+    {
+        PhaseStats &p = (*this)[phase];
+        if (p.line_active_)
+        {
+            p.latency_.record(p.line_ns_);
+            p.line_ns_ = 0;
+            p.line_active_ = false;
+        }
+    }
+
+    // Records the end-to-end latency of a line (numbered as in diagnostics)
+    void end_line(uint64_t line, uint64_t ns)
+    {
+        line_latency_.record(ns);
+        slowest_.record(line, ns);
+    }
+
+    // Lines through end_line() so far. Unlike lines_, safe to read while
+    // other threads are still reading input.
+    uint64_t lines_ended() const
+    {
+        return line_latency_.count();
+    }
+
+    // Percentiles of every histogram, and the slowest lines, as JSON fields
+    void write_latency_json(std::ostream &out, const char *indent = "  ") const
+    {
+        out << indent << "\"latency_ns\": {\n";
+        out << indent << "  \"line\": ";
+        line_latency_.write_json(out);
+        for (int i = 0; i < static_cast<int>(Phase::count); i++)
+        {
+            out << ",\n"
+                << indent << "  \"" << phase_name(static_cast<Phase>(i)) << "\": ";
+            phases_[i].latency_.write_json(out);
+        }
+        out << "\n"
+            << indent << "},\n";
+        out << indent << "\"slowest_lines\": ";
+        slowest_.write_json(out);
+        out << "\n";
+    }
+
+    void write_json(std::ostream &out) const
+    {
+        out << "{\n";
+        out << "  \"lines\": " << lines_ << ",\n";
+        out << "  \"wall_ns\": " << wall_ns_ << ",\n";
+        out << "  \"peak_rss_kb\": " << peak_rss_kb() << ",\n";
+        if (perf_)
+        {
+            out << "  \"perf_source\": \"" << PerfCounters::source_name(thread_perf_counters().source()) << "\",\n";
+        }
+        if (result_cache_)
+        {
+            out << "  \"result_cache\": ";
+            result_cache_->counters().write_json(out);
+            out << ",\n";
+        }
+        out << "  \"phases\": {\n";
+        for (int i = 0; i < static_cast<int>(Phase::count); i++)
+        {
+            const PhaseStats &p = phases_[i];
+            double wall_s = p.wall_ns_ / 1e9;
+            out << "    \"" << phase_name(static_cast<Phase>(i)) << "\": {"
+                << "\"calls\": " << p.calls_
+                << ", \"tokens\": " << p.tokens_
+                << ", \"nodes\": " << p.nodes_
+                << ", \"diagnostics\": " << p.diagnostics_
+                << ", \"wall_ns\": " << p.wall_ns_
+                << ", \"cpu_ns\": " << p.cpu_ns_
+                << ", \"calls_per_s\": " << (wall_s > 0 ? p.calls_ / wall_s : 0);
+            if (perf_)
+            {
+                out << ", \"perf\": {";
+                thread_perf_counters().write_json_fields(out, p.perf_);
+                out << "}";
+            }
+            if (LITTLE_COMPILER_ALLOC_TRACKING)
+            {
+                out << ", ";
+                write_alloc_json_fields(out, i);
+            }
+            out << "}" << (i + 1 < static_cast<int>(Phase::count) || LITTLE_COMPILER_ALLOC_TRACKING ? "," : "") << "\n";
+        }
+        if (LITTLE_COMPILER_ALLOC_TRACKING)
+        {
+            // Allocations made outside of any phase (reading input, setup, ...)
+            out << "    \"other\": {";
+            write_alloc_json_fields(out, alloc_other_phase);
+            out << "}\n";
+        }
+        out << "  },\n";
+        write_latency_json(out);
+        out << "}\n";
+    }
+
+    uint64_t lines_ = 0;   // Input lines, including empty ones
+    uint64_t wall_ns_ = 0; // Whole run, as measured by the driver
+
+private:
+    PhaseStats phases_[static_cast<int>(Phase::count)];
+    bool perf_ = false;
+    LatencyHistogram line_latency_; // End to end
+    SlowestLines slowest_;          // Only touched by the thread calling end_line()
+    const ResultCache *result_cache_ = nullptr;
+};
+
+// Writes a latency report to out if one was asked for since the last call.
+// Must be called from the thread calling end_line().
+inline void report_latency_if_requested(const Stats *stats, std::ostream &out)
+{
+    if (stats && latency_report_requested)
+    {
+        latency_report_requested = 0;
+        out << "{\n  \"lines\": " << stats->lines_ended() << ",\n";
+        stats->write_latency_json(out);
+        out << "}" << std::endl;
+    }
+}
+
+#if LITTLE_COMPILER_STATS
+
+// Adds the wall and CPU time between construction and destruction to a phase,
+// and counts one call. Allocations in between are attributed to the phase too.
+class ScopedPhaseTimer
+{
+public:
+    ScopedPhaseTimer(Stats *stats, Phase phase)
+        : stats_(stats), phase_(phase), alloc_scope_(phase)
+    {
+        if (stats_)
+        {
+            wall_start_ = std::chrono::steady_clock::now();
+            cpu_start_ = Stats::thread_cpu_ns();
+            // Counters are read inside the clock reads, so they only count
+            // the phase (and half of each read of their own)
+            if (stats_->perf_counters_enabled())
+            {
+                perf_start_ = thread_perf_counters().read();
+            }
+        }
+    }
+
+    ~ScopedPhaseTimer()
+    {
+        if (stats_)
+        {
+            PhaseStats &p = (*stats_)[phase_];
+            if (stats_->perf_counters_enabled())
+            {
+                p.perf_ += thread_perf_counters().read() - perf_start_;
+            }
+            p.calls_++;
+            uint64_t wall_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                   std::chrono::steady_clock::now() - wall_start_)
+                                   .count();
+            p.wall_ns_ += wall_ns;
+            p.cpu_ns_ += Stats::thread_cpu_ns() - cpu_start_;
+            p.line_ns_ += wall_ns;
+            p.line_active_ = true;
+        }
+    }
+
+private:
+    Stats *stats_;
+    Phase phase_;
+    AllocPhaseScope alloc_scope_;
+    std::chrono::steady_clock::time_point wall_start_;
+    uint64_t cpu_start_;
+    PerfSample perf_start_;
+};
+
+// Times a whole line, for drivers that run every phase of a line on the
+// calling thread. On destruction, closes the line for every phase too.
+class ScopedLineTimer
+{
+public:
+    ScopedLineTimer(Stats *stats, uint64_t line)
+        : stats_(stats), line_(line)
+    {
+        if (stats_)
+        {
+            start_ = std::chrono::steady_clock::now();
+        }
+    }
+
+    ~ScopedLineTimer()
+    {
+        if (stats_)
+        {
+            for (int i = 0; i < static_cast<int>(Phase::count); i++)
+            {
+                stats_->end_line_phase(static_cast<Phase>(i));
+            }
+            stats_->end_line(line_, std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                        std::chrono::steady_clock::now() - start_)
+                                        .count());
+        }
+    }
+
+private:
+    Stats *stats_;
+    uint64_t line_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+inline void count_tokens(Stats *stats, Phase phase, uint64_t n)
+{
+    if (stats)
+        (*stats)[phase].tokens_ += n;
+}
+
+inline void count_nodes(Stats *stats, Phase phase, uint64_t n)
+{
+    if (stats)
+        (*stats)[phase].nodes_ += n;
+}
+
+inline void count_diagnostics(Stats *stats, Phase phase, uint64_t n)
+{
+    if (stats)
+        (*stats)[phase].diagnostics_ += n;
+}
+
+#else
+
+class ScopedPhaseTimer
+{
+public:
+    ScopedPhaseTimer(Stats *, Phase phase) : alloc_scope_(phase) {}
+
+private:
+    AllocPhaseScope alloc_scope_;
+};
+
+class ScopedLineTimer
+{
+public:
+    ScopedLineTimer(Stats *, uint64_t) {}
+};
+
+inline void count_tokens(Stats *, Phase, uint64_t) {}
+inline void count_nodes(Stats *, Phase, uint64_t) {}
+inline void count_diagnostics(Stats *, Phase, uint64_t) {}
+
+#endif
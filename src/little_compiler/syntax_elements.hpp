@@ -2,7 +2,9 @@
 
 #include "token.hpp"
 
+#include <algorithm>
 #include <iostream>
+#include <memory>
 #include <vector>
 
 // Describes the type of node in the AST
@@ -20,13 +22,14 @@ enum class SyntaxTag
 };
 
 class SyntaxNode;
-std::ostream &operator<<(std::ostream &out, const SyntaxNode &node);
+inline std::ostream &operator<<(std::ostream &out, const SyntaxNode &node);
 
 // A syntax node represents a node in the AST , and is a base class of all expressions.
 class SyntaxNode
 {
 public:
-    SyntaxNode(Token tok, SyntaxTag tag) : tok_(tok), tag_(tag)
+    SyntaxNode(Token tok, SyntaxTag tag, size_t size = 1, size_t height = 1)
+        : tok_(tok), tag_(tag), size_(size), height_(height)
     {
     }
 
@@ -38,6 +41,8 @@ public:
 
     Token tok_;
     SyntaxTag tag_;
+    size_t size_;   // Number of nodes in this subtree, computed while parsing
+    size_t height_; // Nodes on its longest path down, computed while parsing
 
     // Print all children recursively
     void print(std::ostream &out, std::string indent = "", bool is_last = true) const
@@ -56,7 +61,7 @@ public:
 };
 
 // Print support for SyntaxNode
-std::ostream &operator<<(std::ostream &out, const SyntaxNode &node)
+inline std::ostream &operator<<(std::ostream &out, const SyntaxNode &node)
 {
     node.print(out);
     return out;
@@ -90,7 +95,9 @@ struct BinaryExpression : public SyntaxNode
     using ptr_type = std::shared_ptr<SyntaxNode>;
 
     BinaryExpression(ptr_type left, Token op, ptr_type right)
-        : SyntaxNode(op, SyntaxTag::binary_expression), left_(left), right_(right)
+        : SyntaxNode(op, SyntaxTag::binary_expression, 1 + left->size_ + right->size_,
+                     1 + std::max(left->height_, right->height_)),
+          left_(left), right_(right)
     {
     }
 
@@ -110,7 +117,7 @@ struct UnaryExpression : public SyntaxNode
     using ptr_type = std::shared_ptr<SyntaxNode>;
 
     UnaryExpression(Token op, ptr_type expr)
-        : SyntaxNode(op, SyntaxTag::unary_expression), expr_(expr)
+        : SyntaxNode(op, SyntaxTag::unary_expression, 1 + expr->size_, 1 + expr->height_), expr_(expr)
     {
     }
 
@@ -128,7 +135,8 @@ struct ParenthesizedExpression : public SyntaxNode
 
     ParenthesizedExpression(Token paren_open, ptr_type expr, Token paren_close)
         // TOFIX: A base class with a token member doesn't make sense here
-        : SyntaxNode(paren_open, SyntaxTag::parenthesized_expression), paren_open_(paren_open),
+        : SyntaxNode(paren_open, SyntaxTag::parenthesized_expression, 1 + expr->size_, 1 + expr->height_),
+          paren_open_(paren_open),
           expr_(expr), paren_close_(paren_close)
     {
     }
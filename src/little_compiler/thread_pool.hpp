@@ -0,0 +1,89 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed-size pool of worker threads, fed through a bounded queue.
+// submit() blocks while the queue is full, pushing back on producers instead
+// of letting the backlog grow without limit.
+class ThreadPool
+{
+public:
+    // Tasks receive the index of the worker running them, so callers can keep
+    // per-worker state (ie a little::Context) without any locking.
+    using Task = std::function<void(size_t worker)>;
+
+    ThreadPool(size_t workers, size_t max_queued)
+        : max_queued_(max_queued), stopping_(false)
+    {
+        for (size_t i = 0; i < workers; i++)
+        {
+            workers_.emplace_back([this, i]()
+                                  { run(i); });
+        }
+    }
+
+    // Finishes all queued tasks before joining the workers
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        not_empty_.notify_all();
+        for (auto &worker : workers_)
+        {
+            worker.join();
+        }
+    }
+
+    void submit(Task task)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            not_full_.wait(lock, [this]()
+                           { return tasks_.size() < max_queued_; });
+            tasks_.push_back(std::move(task));
+        }
+        not_empty_.notify_one();
+    }
+
+    size_t size() const
+    {
+        return workers_.size();
+    }
+
+private:
+    void run(size_t worker)
+    {
+        while (true)
+        {
+            Task task;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                not_empty_.wait(lock, [this]()
+                                { return stopping_ || !tasks_.empty(); });
+                if (tasks_.empty())
+                {
+                    return;
+                }
+                task = std::move(tasks_.front());
+                tasks_.pop_front();
+            }
+            not_full_.notify_one();
+            task(worker);
+        }
+    }
+
+    std::mutex mutex_;
+    std::condition_variable not_empty_;
+    std::condition_variable not_full_;
+    std::deque<Task> tasks_;
+    size_t max_queued_;
+    bool stopping_;
+    std::vector<std::thread> workers_;
+};
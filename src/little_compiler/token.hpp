@@ -33,7 +33,7 @@ enum class TokenTag
 };
 
 // Print support for TokenTag
-std::ostream &operator<<(std::ostream &os, TokenTag tag)
+inline std::ostream &operator<<(std::ostream &os, TokenTag tag)
 {
 #define TOKEN_TAG_CASE(tag) \
     case TokenTag::tag:     \
@@ -69,6 +69,47 @@ std::ostream &operator<<(std::ostream &os, TokenTag tag)
     return os;
 }
 
+// if tag represents binary operation, returns its precedence
+// else, returns 0
+constexpr int binary_operator_precedence(TokenTag tag)
+{
+    switch (tag)
+    {
+    case TokenTag::double_ampersand:
+    case TokenTag::double_vertical:
+        return 6;
+    case TokenTag::less_than:
+    case TokenTag::greater_than:
+        return 5;
+    case TokenTag::star:
+    case TokenTag::slash:
+        return 3;
+    case TokenTag::plus:
+    case TokenTag::minus:
+        return 2;
+    case TokenTag::equal:
+    case TokenTag::not_equal:
+        return 1;
+    default:
+        return 0;
+    }
+}
+
+// if tag represents unary operation, returns its precedence
+// else, returns 0
+constexpr int unary_operator_precedence(TokenTag tag)
+{
+    switch (tag)
+    {
+    case TokenTag::plus:
+    case TokenTag::minus:
+    case TokenTag::bang:
+        return 5;
+    default:
+        return 0;
+    }
+}
+
 class Token
 {
 public:
@@ -85,43 +126,16 @@ public:
 
     // if tok represents binary operation, returns its precedence
     // else, returns 0
-    int get_binary_operator_precedence()
+    int get_binary_operator_precedence() const
     {
-        switch (tag_)
-        {
-        case TokenTag::double_ampersand:
-        case TokenTag::double_vertical:
-            return 6;
-        case TokenTag::less_than:
-        case TokenTag::greater_than:
-            return 5;
-        case TokenTag::star:
-        case TokenTag::slash:
-            return 3;
-        case TokenTag::plus:
-        case TokenTag::minus:
-            return 2;
-        case TokenTag::equal:
-        case TokenTag::not_equal:
-            return 1;
-        default:
-            return 0;
-        }
+        return binary_operator_precedence(tag_);
     }
 
-    // if tok represents binary operation, returns its precedence
+    // if tok represents unary operation, returns its precedence
     // else, returns 0
-    int get_unary_operator_precedence()
+    int get_unary_operator_precedence() const
     {
-        switch (tag_)
-        {
-        case TokenTag::plus:
-        case TokenTag::minus:
-        case TokenTag::bang:
-            return 5;
-        default:
-            return 0;
-        }
+        return unary_operator_precedence(tag_);
     }
 
     void print(std::ostream &out) const
@@ -143,7 +157,7 @@ public:
 };
 
 // Print support for tokens
-std::ostream &operator<<(std::ostream &out, const Token &tok)
+inline std::ostream &operator<<(std::ostream &out, const Token &tok)
 {
     tok.print(out);
     return out;
@@ -0,0 +1,44 @@
+# Tokens of the little_compiler language, for GeneratedLexer.
+#
+# scanner_generator turns this into the tables of one minimized DFA
+# (scanner_tables.hpp) at build time. Before each token, GeneratedLexer takes
+# the longest match of every [trivia] rule as many times as they match, then
+# of a [comment] rule once, then of a [token] rule. Among matches of the same
+# length, the rule listed first wins. Where no token rule matches, the byte is
+# a bad token.
+#
+# Rules are "<action> <regex>", and in [token], "<TokenTag> <position> <regex>":
+# the token's position is one past its end, or its last byte (as the
+# hand-written lexer reports operators). The regex is the rest of the line.
+# Regexes have literals, '.', [classes], \escapes, |, *, + and ? and groups.
+# Lines are null-terminated, so no regex ever matches '\0'.
+
+[trivia]
+skip                [ \t]+
+newline             \n
+
+# Only one comment is skipped, right before a token, and block comments end
+# at the first '*', which must be followed by '/'
+[comment]
+comment             //[^\n]*
+comment             /\*[^*]*\*/
+unclosed_comment    /\*[^*]*\*?
+
+[token]
+id                  end     [A-Za-z][A-Za-z0-9]*
+val_int             end     [0-9]+
+val_double          end     [0-9]+\.[0-9]*|\.[0-9]+
+
+double_ampersand    last    &&
+equal               last    ==
+not_equal           last    !=
+
+plus                last    \+
+minus               last    -
+star                last    \*
+slash               last    /
+parenthesis_open    last    \(
+parenthesis_close   last    \)
+bang                last    !
+greater_than        last    >
+less_than           last    <
@@ -0,0 +1,216 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Subtrees smaller than this are never split across threads: below it, the
+// cost of handing work over outweighs the work itself.
+constexpr size_t default_fork_threshold = 1 << 12;
+
+// Pool of worker threads for fork-join parallelism, ie join(a, b) runs a and b
+// concurrently and returns once both are done.
+//
+// Each worker has its own deque of tasks: it pushes and pops at the back, and
+// idle workers steal from the front of the others. A thread waiting in join()
+// runs other tasks in the meantime, so nested joins never deadlock. Threads
+// that aren't workers share one extra deque.
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(size_t workers)
+        : queues_(workers + 1)
+    {
+        for (auto &queue : queues_)
+        {
+            queue = std::make_unique<Queue>();
+        }
+        for (size_t i = 0; i < workers; i++)
+        {
+            workers_.emplace_back([this, i]()
+                                  { work(i); });
+        }
+    }
+
+    ~WorkStealingPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+            stopping_ = true;
+        }
+        sleep_cv_.notify_all();
+        for (auto &worker : workers_)
+        {
+            worker.join();
+        }
+    }
+
+    size_t size() const
+    {
+        return workers_.size();
+    }
+
+    // Runs a on the calling thread, and b on whichever thread gets to it
+    // first. Exceptions are rethrown here, a's first.
+    template <typename A, typename B>
+    void join(A &&a, B &&b)
+    {
+        Task task(std::function<void()>(std::forward<B>(b)));
+        push(&task);
+
+        std::exception_ptr error;
+        try
+        {
+            a();
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        // Usually b is still at the back of our own deque; if it was stolen,
+        // help with other tasks until it's done
+        while (!task.done_.load(std::memory_order_acquire))
+        {
+            if (Task *other = take())
+            {
+                run(other);
+            }
+            else
+            {
+                std::this_thread::yield();
+            }
+        }
+
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+        if (task.error_)
+        {
+            std::rethrow_exception(task.error_);
+        }
+    }
+
+private:
+    struct Task
+    {
+        explicit Task(std::function<void()> fn) : fn_(std::move(fn)) {}
+
+        std::function<void()> fn_;
+        std::atomic<bool> done_{false};
+        std::exception_ptr error_;
+    };
+
+    struct Queue
+    {
+        std::mutex mutex_;
+        std::deque<Task *> tasks_;
+    };
+
+    // Deque of the calling thread
+    Queue &own_queue()
+    {
+        return *queues_[worker_pool_ == this ? worker_index_ : workers_.size()];
+    }
+
+    void push(Task *task)
+    {
+        // Counted first, so that takers never see it go below zero
+        queued_.fetch_add(1, std::memory_order_release);
+        Queue &queue = own_queue();
+        {
+            std::lock_guard<std::mutex> lock(queue.mutex_);
+            queue.tasks_.push_back(task);
+        }
+        {
+            // Pairs with the check in work(), so the wake up can't be missed
+            std::lock_guard<std::mutex> lock(sleep_mutex_);
+        }
+        sleep_cv_.notify_one();
+    }
+
+    // Newest task of our own deque, or else the oldest of another one
+    Task *take()
+    {
+        if (queued_.load(std::memory_order_acquire) == 0)
+        {
+            return nullptr;
+        }
+        Queue &own = own_queue();
+        {
+            std::lock_guard<std::mutex> lock(own.mutex_);
+            if (!own.tasks_.empty())
+            {
+                Task *task = own.tasks_.back();
+                own.tasks_.pop_back();
+                queued_.fetch_sub(1, std::memory_order_relaxed);
+                return task;
+            }
+        }
+        for (auto &queue : queues_)
+        {
+            std::lock_guard<std::mutex> lock(queue->mutex_);
+            if (!queue->tasks_.empty())
+            {
+                Task *task = queue->tasks_.front();
+                queue->tasks_.pop_front();
+                queued_.fetch_sub(1, std::memory_order_relaxed);
+                return task;
+            }
+        }
+        return nullptr;
+    }
+
+    static void run(Task *task)
+    {
+        try
+        {
+            task->fn_();
+        }
+        catch (...)
+        {
+            task->error_ = std::current_exception();
+        }
+        task->done_.store(true, std::memory_order_release);
+    }
+
+    void work(size_t index)
+    {
+        worker_pool_ = this;
+        worker_index_ = index;
+        while (true)
+        {
+            if (Task *task = take())
+            {
+                run(task);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleep_mutex_);
+            sleep_cv_.wait(lock, [this]()
+                           { return stopping_ || queued_.load(std::memory_order_acquire) != 0; });
+            if (stopping_)
+            {
+                return;
+            }
+        }
+    }
+
+    std::vector<std::unique_ptr<Queue>> queues_; // One per worker, then one for other threads
+    std::vector<std::thread> workers_;
+    std::atomic<size_t> queued_{0};
+
+    std::mutex sleep_mutex_;
+    std::condition_variable sleep_cv_;
+    bool stopping_ = false;
+
+    // Identifies worker threads, and their deque
+    static inline thread_local WorkStealingPool *worker_pool_ = nullptr;
+    static inline thread_local size_t worker_index_ = 0;
+};
@@ -0,0 +1,361 @@
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Generates synthetic input files for main: one random expression per line,
+// well-typed unless an error is injected on purpose.
+//
+// Output only depends on the options and the seed, and lines are written as
+// they are generated, so files of any size can be streamed.
+
+namespace
+{
+    // splitmix64: tiny, fast, and identical on every platform (unlike the
+    // standard distributions)
+    class Random
+    {
+    public:
+        explicit Random(uint64_t seed) : state_(seed) {}
+
+        uint64_t next()
+        {
+            uint64_t z = (state_ += 0x9e3779b97f4a7c15ULL);
+            z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+            z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+            return z ^ (z >> 31);
+        }
+
+        // Uniform in [0, n)
+        uint64_t below(uint64_t n)
+        {
+            return next() % n;
+        }
+
+        // True with probability p
+        bool chance(double p)
+        {
+            return (next() >> 11) * (1.0 / (UINT64_C(1) << 53)) < p;
+        }
+
+    private:
+        uint64_t state_;
+    };
+
+    enum class Type
+    {
+        integer,
+        floating,
+        boolean
+    };
+
+    struct Options
+    {
+        uint64_t lines_ = 1000;
+        unsigned depth_ = 4; // Maximum nesting of operators
+        // Relative weights of each kind of operator
+        unsigned arithmetic_ = 4; // + - * /
+        unsigned comparison_ = 2; // < > == != on numbers
+        unsigned logical_ = 1;    // && == != on booleans
+        unsigned unary_ = 1;      // + - on numbers, ! on booleans
+        // Literal types in use (and so, the types of expressions)
+        bool integers_ = true;
+        bool floats_ = true;
+        bool booleans_ = true;
+        double comment_density_ = 0.05; // Chance of a comment before each literal, and at the end of each line
+        double error_rate_ = 0;         // Chance of a lexer, parser or type error in a line
+        uint64_t seed_ = 1;
+    };
+
+    class Generator
+    {
+    public:
+        Generator(const Options &options) : options_(options), random_(options.seed_)
+        {
+            if (options_.integers_)
+                types_.push_back(Type::integer);
+            if (options_.floats_)
+                types_.push_back(Type::floating);
+            if (options_.booleans_)
+                types_.push_back(Type::boolean);
+            if (options_.integers_)
+                numeric_types_.push_back(Type::integer);
+            if (options_.floats_)
+                numeric_types_.push_back(Type::floating);
+        }
+
+        // Appends one line, without the newline
+        void line(std::string &out)
+        {
+            size_t start = out.size();
+            Type type = types_[random_.below(types_.size())];
+            expression(out, type, options_.depth_);
+
+            if (random_.chance(options_.error_rate_))
+            {
+                inject_error(out, start, type);
+            }
+            if (random_.chance(options_.comment_density_))
+            {
+                out += " // trailing comment";
+            }
+        }
+
+    private:
+        void expression(std::string &out, Type type, unsigned depth)
+        {
+            // Leaves get more likely as depth runs out
+            if (depth == 0 || random_.chance(1.0 / (depth + 1)))
+            {
+                literal(out, type);
+                return;
+            }
+
+            bool numeric = type != Type::boolean;
+            unsigned binary = numeric ? options_.arithmetic_ : options_.logical_;
+            unsigned comparison = numeric || numeric_types_.empty() ? 0 : options_.comparison_;
+            unsigned unary = options_.unary_;
+            unsigned total = binary + comparison + unary;
+            if (total == 0)
+            {
+                literal(out, type);
+                return;
+            }
+
+            uint64_t pick = random_.below(total);
+            if (pick < unary)
+            {
+                out += numeric ? (random_.chance(0.5) ? "-" : "+") : "!";
+                operand(out, type, depth - 1);
+            }
+            else if (pick < unary + binary)
+            {
+                static const char *arithmetic[] = {" + ", " - ", " * ", " / "};
+                static const char *logical[] = {" && ", " == ", " != "};
+                const char *op = numeric ? arithmetic[random_.below(4)] : logical[random_.below(3)];
+                operand(out, type, depth - 1);
+                out += op;
+                operand(out, type, depth - 1);
+            }
+            else
+            {
+                static const char *comparisons[] = {" < ", " > ", " == ", " != "};
+                Type operand_type = numeric_types_[random_.below(numeric_types_.size())];
+                operand(out, operand_type, depth - 1);
+                out += comparisons[random_.below(4)];
+                operand(out, operand_type, depth - 1);
+            }
+        }
+
+        // Precedence doesn't follow types in this language (&& binds tighter
+        // than <), so compound operands are parenthesized
+        void operand(std::string &out, Type type, unsigned depth)
+        {
+            size_t start = out.size();
+            expression(out, type, depth);
+            if (out.size() - start > literal_length_)
+            {
+                out.insert(start, "(");
+                out += ")";
+            }
+        }
+
+        void literal(std::string &out, Type type)
+        {
+            size_t start = out.size();
+            // Comments are only skipped when a token directly follows them
+            if (random_.chance(options_.comment_density_))
+            {
+                out += "/* note */";
+            }
+
+            switch (type)
+            {
+            case Type::integer:
+                // Small enough for the evaluator's int conversion
+                out += std::to_string(random_.below(1000));
+                break;
+            case Type::floating:
+                switch (random_.below(3))
+                {
+                case 0:
+                    out += std::to_string(random_.below(1000)) + "." + std::to_string(random_.below(100));
+                    break;
+                case 1:
+                    out += "." + std::to_string(random_.below(1000));
+                    break;
+                default:
+                    out += std::to_string(random_.below(100)) + ".";
+                    break;
+                }
+                break;
+            case Type::boolean:
+                out += random_.chance(0.5) ? "true" : "false";
+                break;
+            }
+            literal_length_ = out.size() - start;
+        }
+
+        void inject_error(std::string &out, size_t start, Type type)
+        {
+            switch (random_.below(3))
+            {
+            case 0:
+                // Invalid character, at either end so it never lands in a comment
+                out.insert(random_.chance(0.5) ? start : out.size(), "$");
+                break;
+            case 1:
+                // Missing operand
+                out += " *";
+                break;
+            default:
+                // Mismatched operand types
+                out.insert(start, "(");
+                out += type == Type::boolean ? ") + 1" : ") + true";
+                break;
+            }
+        }
+
+        Options options_;
+        Random random_;
+        std::vector<Type> types_;
+        std::vector<Type> numeric_types_;
+        size_t literal_length_ = 0; // Of the last literal (and its comment), to tell leaves apart in operand()
+    };
+
+    // Parses a "kind:weight,..." operator mix
+    bool parse_operator_mix(const std::string &str, Options &options)
+    {
+        options.arithmetic_ = options.comparison_ = options.logical_ = options.unary_ = 0;
+        size_t pos = 0;
+        while (pos < str.size())
+        {
+            size_t end = str.find(',', pos);
+            if (end == std::string::npos)
+                end = str.size();
+            std::string item = str.substr(pos, end - pos);
+            pos = end + 1;
+
+            size_t colon = item.find(':');
+            if (colon == std::string::npos)
+                return false;
+            std::string kind = item.substr(0, colon);
+            unsigned weight = std::stoul(item.substr(colon + 1));
+            if (kind == "arithmetic")
+                options.arithmetic_ = weight;
+            else if (kind == "comparison")
+                options.comparison_ = weight;
+            else if (kind == "logical")
+                options.logical_ = weight;
+            else if (kind == "unary")
+                options.unary_ = weight;
+            else
+                return false;
+        }
+        return true;
+    }
+
+    // Parses a "int,float,bool" list of literal types
+    bool parse_literals(const std::string &str, Options &options)
+    {
+        options.integers_ = options.floats_ = options.booleans_ = false;
+        size_t pos = 0;
+        while (pos < str.size())
+        {
+            size_t end = str.find(',', pos);
+            if (end == std::string::npos)
+                end = str.size();
+            std::string item = str.substr(pos, end - pos);
+            pos = end + 1;
+
+            if (item == "int")
+                options.integers_ = true;
+            else if (item == "float")
+                options.floats_ = true;
+            else if (item == "bool")
+                options.booleans_ = true;
+            else
+                return false;
+        }
+        return options.integers_ || options.floats_ || options.booleans_;
+    }
+
+    void usage(const char *name)
+    {
+        std::cout << "Usage: " << name << " [--lines=N] [--depth=N] [--seed=N] [--output=<file>]"
+                  << " [--operators=arithmetic:4,comparison:2,logical:1,unary:1]"
+                  << " [--literals=int,float,bool] [--comment-density=P] [--error-rate=P]" << std::endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    Options options;
+    std::string output_file;
+
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = argv[i];
+        std::string value = arg.substr(arg.find('=') + 1);
+        bool ok = true;
+        if (arg.rfind("--lines=", 0) == 0)
+            options.lines_ = std::stoull(value);
+        else if (arg.rfind("--depth=", 0) == 0)
+            options.depth_ = std::stoul(value);
+        else if (arg.rfind("--seed=", 0) == 0)
+            options.seed_ = std::stoull(value);
+        else if (arg.rfind("--output=", 0) == 0)
+            output_file = value;
+        else if (arg.rfind("--operators=", 0) == 0)
+            ok = parse_operator_mix(value, options);
+        else if (arg.rfind("--literals=", 0) == 0)
+            ok = parse_literals(value, options);
+        else if (arg.rfind("--comment-density=", 0) == 0)
+            options.comment_density_ = std::stod(value);
+        else if (arg.rfind("--error-rate=", 0) == 0)
+            options.error_rate_ = std::stod(value);
+        else
+            ok = false;
+
+        if (!ok)
+        {
+            std::cout << "Invalid argument: " << arg << std::endl;
+            usage(argv[0]);
+            return -1;
+        }
+    }
+
+    // Same buffering as main: one large buffer, no syncing with C stdio
+    std::ios::sync_with_stdio(false);
+    static char out_buffer[1 << 20];
+    std::ofstream file;
+    std::ostream *out = &std::cout;
+    if (!output_file.empty())
+    {
+        file.rdbuf()->pubsetbuf(out_buffer, sizeof(out_buffer));
+        file.open(output_file, std::ios::binary);
+        if (!file)
+        {
+            std::cout << "Can't open " << output_file << std::endl;
+            return -1;
+        }
+        out = &file;
+    }
+    else
+    {
+        std::cout.rdbuf()->pubsetbuf(out_buffer, sizeof(out_buffer));
+    }
+
+    Generator generator(options);
+    std::string line;
+    for (uint64_t i = 0; i < options.lines_; i++)
+    {
+        line.clear();
+        generator.line(line);
+        line += '\n';
+        out->write(line.data(), line.size());
+    }
+    out->flush();
+    return *out ? 0 : -1;
+}